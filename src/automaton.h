@@ -13,13 +13,28 @@
 
 #include <string.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <errno.h>
 #include <unistd.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include "memalloc.h"
 #include "msg_pipe.h"
 #include "fork.h"
+#include "automaton_simd.h"
+
+/**
+ * Set of automaton states stored as array of 64-bit words
+ * (bit q%64 of the word q/64 is set if state q belongs to the set).
+ *
+ * Number of the words is the setWords value of the transition graph.
+ */
+typedef uint64_t* StateSet;
 
 /**
  * Iternal type of the transition graph
@@ -32,20 +47,187 @@ typedef struct TransitionGraphImpl TransitionGraphImpl;
  */
 typedef TransitionGraphImpl* TransitionGraph;
 
+/**
+ * Type of the backward step on sets of states (see stateSetStepBack)
+ */
+typedef void (*StateSetStepFn)(TransitionGraph tg, const uint64_t* next, int c, StateSet out);
+
+/**
+ * Type of the accept function variant (see acceptBitset)
+ */
+typedef int (*AcceptVariantFn)(TransitionGraph tg, char* word);
+
 /**
  * Strucutre containing the transition graph.
+ *
+ * Letters are grouped into classes: letters with equal successors in every state share a class
+ * (see letterClass). Letters without any transitions (including the ones outside the alphabet) have class -1.
+ * The engines translate each letter of the word to its class once and use only classes afterwards.
+ *
+ * Transitions are stored in compressed sparse row layout:
+ * each (q,c) pair (c is letter class) is a row with index q*C+c and its successors are stored one after another
+ * in the edges array starting at rowOffset[q*C+c] and ending before rowOffset[q*C+c+1].
+ *
+ * Dense rows (the ones for which the set of successors takes no more memory than the list of them)
+ * have additionally their successors set stored in denseMasks.
+ *
+ * If they fit in STEP_TABLES_MEMORY_LIMIT the step tables (transposed successors, see automaton_simd.h)
+ * are built as well, so the backward step (see stateSetStepBack) is done with vector instructions.
  */
 struct TransitionGraphImpl {
-    int graph[MAX_Q][MAX_A][MAX_Q]; ///< graph[q][a][i] means that theres edge between states q -> graph[q][a][i] by letter a
-    int size[MAX_Q][MAX_A];         ///< size[q][a] is the valid size of graph[q][a][i] (number of q by-letter-a neighbours)
-    int acceptingStates[MAX_Q];     ///< accepting states list
+    int letterClass[256];           ///< letterClass[a] is the class of the letter with index a (-1 if the letter has no transitions)
+    int* rowOffset;                 ///< rowOffset[q*C+c] is the position of the first successor of (q,c) in edges (Q*C+1 entries)
+    int* edges;                     ///< edges[rowOffset[q*C+c]+i] means that theres edge between states q -> edges[rowOffset[q*C+c]+i] by letters of class c
+    int* denseRow;                  ///< denseRow[q*C+c] is the index of the (q,c) successors set in denseMasks or -1 for sparse rows
+    uint64_t* denseMasks;           ///< successors sets of the dense rows (setWords words per row)
+    int edgeCount;                  ///< number of edges
+    int denseCount;                 ///< number of dense rows
+    char* acceptingStates;          ///< acceptingStates[q] is 1 if q is accepting state (Q entries)
+    StateSet acceptingMask;         ///< set of the accepting states
+    int setWords;                   ///< number of 64-bit words in a set of states
+    uint64_t* stepTables;           ///< step tables of the letter classes (NULL if not built) - see automaton_simd.h
+    uint64_t* stepMasks;            ///< existential states set followed by universal states set (stepStride words each)
+    int stepChunks;                 ///< number of 8-state chunks in the step tables
+    int stepStride;                 ///< number of words in a row of the step tables
+    const StepKernelInfo* stepKernel; ///< kernel used with the step tables
+    StateSetStepFn stepBack;        ///< backward step specialized for the number of states (see selectTransitionGraphVariant)
+    AcceptVariantFn bitsetAccept;   ///< bitset accept specialized for the number of states
+    int variantWords;               ///< set width of the specialized engines (0 for the dynamic ones)
+    const char* image;              ///< image the arrays point into (NULL if the graph owns them) - see automaton_image.h
+    size_t imageSize;               ///< size of the image mapped for the graph (0 if it's not mapped by the graph)
+    int* minAccept;                 ///< lower bound of the length of words accepted from q (INT_MAX if q rejects every word) - see analyseTransitionGraph
+    int* maxAccept;                 ///< upper bound of the length of words accepted from q (INT_MAX if unbounded)
+    int* minReject;                 ///< lower bound of the length of words rejected from q (INT_MAX if q accepts every word)
+    int* maxReject;                 ///< upper bound of the length of words rejected from q (INT_MAX if unbounded)
+    int nonEmptyRows;               ///< number of the rows with at least one successor - see transitionGraphStatistics
+    double branching;               ///< average number of successors of the non-empty rows
+    double universalRatio;          ///< part of the states being universal
+    double* treeCounts;             ///< scratch buffer of estimateRunTree (2*Q entries, all zero between the calls)
+    int* treeFrontier;              ///< scratch buffer of estimateRunTree (2*Q entries)
     int q0; ///<  initial state
-    int A;  ///<  the size of the alphabet: the alphabet is the set {a,...,x}, where 'x'-'a' = A-1
+    int A;  ///<  the size of the alphabet: the alphabet is the set of A letters {a,...}, where letter index of byte c is (unsigned char)(c-'a')
+    int C;  ///<  the number of letter classes: the classes are the set {0,...,C-1}
     int Q;  ///<  the number of states: the states are the set {0,...,Q-1}
     int U;  ///<  the number of universal states: universal states = {0, .., U-1}, existential states = {U, .., Q-1}
     int F;  ///<  the number of final states
 };
 
+/**
+ * Returns letter index of the given byte.
+ * The letters are all the 256 byte values ordered starting from 'a' (so 'a' is 0, 'b' is 1 and so on).
+ *
+ * @param[in] c : Letter byte
+ * @returns Letter index (between 0 and 255)
+ */
+static inline int letterIndex(char c) {
+    return (int)(unsigned char)(c - 'a');
+}
+
+/**
+ * Returns class of the given byte (see TransitionGraphImpl letterClass).
+ *
+ * @param[in] tg : Transition graph
+ * @param[in] c  : Letter byte
+ * @returns Letter class or -1 if the letter has no transitions
+ */
+static inline int letterClassOf(const TransitionGraph tg, char c) {
+    return tg->letterClass[letterIndex(c)];
+}
+
+/**
+ * Returns number of the successors of state @p q by letters of class @p c (size of T(q,a) for a in class c).
+ * For class -1 (letters without transitions) it's always 0.
+ *
+ * @param[in] tg : Transition graph
+ * @param[in] q  : State
+ * @param[in] c  : Letter class (see letterClassOf)
+ * @returns Number of the successors
+ */
+static inline int transitionCount(const TransitionGraph tg, int q, int c) {
+    if(c < 0 || c >= tg->C) {
+        return 0;
+    }
+    const int row = q * tg->C + c;
+    return tg->rowOffset[row + 1] - tg->rowOffset[row];
+}
+
+/**
+ * Returns array of the successors of state @p q by letters of class @p c (elements of T(q,a) for a in class c).
+ * The array has transitionCount(tg, q, c) elements.
+ *
+ * @param[in] tg : Transition graph
+ * @param[in] q  : State
+ * @param[in] c  : Letter class (see letterClassOf)
+ * @returns Array of the successors
+ */
+static inline const int* transitionTargets(const TransitionGraph tg, int q, int c) {
+    if(c < 0 || c >= tg->C) {
+        return tg->edges;
+    }
+    return tg->edges + tg->rowOffset[q * tg->C + c];
+}
+
+/**
+ * Returns number of 64-bit words needed to store a set of @p Q states.
+ *
+ * @param[in] Q : Number of states
+ * @returns Number of words
+ */
+static inline int stateSetWords(int Q) {
+    const int words = (Q + 63) / 64;
+#if USE_FIXED_WIDTH_ENGINES == 1
+    if(words == 3) {
+        // Padded to the width of the engines specialized for Q <= 256
+        return 4;
+    }
+#endif
+    return words;
+}
+
+/**
+ * Removes all states from the set.
+ *
+ * @param[in] set   : State set
+ * @param[in] words : Number of words in the set
+ */
+static inline void stateSetClear(StateSet set, int words) {
+    for(int w=0;w<words;++w) {
+        set[w] = 0;
+    }
+}
+
+/**
+ * Copies the set.
+ *
+ * @param[in] dest  : Destination set
+ * @param[in] src   : Source set
+ * @param[in] words : Number of words in the sets
+ */
+static inline void stateSetCopy(StateSet dest, const uint64_t* src, int words) {
+    memcpy(dest, src, words * sizeof(uint64_t));
+}
+
+/**
+ * Adds state to the set.
+ *
+ * @param[in] set : State set
+ * @param[in] q   : State to be added
+ */
+static inline void stateSetAdd(StateSet set, int q) {
+    set[q / 64] |= ((uint64_t)1) << (q % 64);
+}
+
+/**
+ * Checks if the state belongs to the set.
+ *
+ * @param[in] set : State set
+ * @param[in] q   : State to be checked
+ * @returns If q belongs to the set?
+ */
+static inline int stateSetHas(const uint64_t* set, int q) {
+    return (set[q / 64] >> (q % 64)) & 1;
+}
+
 /**
  * Prints the transition graph to the standard output.
  *
@@ -62,13 +244,14 @@ struct TransitionGraphImpl {
  */
 void printTransitionGraph(const TransitionGraph tg) {
     printf("Transition graph: {\n");
-    for(int q=0;q<MAX_Q;++q) {
-        for(int a=0;a<MAX_A;++a) {
-            const int size = tg->size[q][a];
+    for(int q=0;q<tg->Q;++q) {
+        for(int a=0;a<tg->A;++a) {
+            const int size = transitionCount(tg, q, tg->letterClass[a]);
+            const int* targets = transitionTargets(tg, q, tg->letterClass[a]);
             if(size > 0) {
                 printf("  %d --[%c]--> { ", q, (char)(a+'a'));
                 for(int r=0;r<size;++r) {
-                    printf("%d ", tg->graph[q][a][r]);
+                    printf("%d ", targets[r]);
                 }
                 printf("}\n");
             }
@@ -80,201 +263,1698 @@ void printTransitionGraph(const TransitionGraph tg) {
 /**
  * Used to initialize transition graph.
  * This method can be used to clean the graph.
+ *
+ * NOTE:
+ *   This function does not free the transitions of the previously loaded graph
+ *   (use freeTransitionGraph for that purpose).
  * 
  * @param[in] tg : Input transition graph
  */
 void initTransitionGraph(TransitionGraph tg) {
     tg->q0 = 0;
     tg->A = 0;
+    tg->C = 0;
     tg->Q = 0;
     tg->U = 0;
     tg->F = 0;
-    for(int q=0;q<MAX_Q;++q) {
-        tg->acceptingStates[q] = 0;
-        for(int a=0;a<MAX_A;++a) {
-            tg->size[q][a] = 0;
-            for(int p=0;p<MAX_Q;++p) {
-                tg->graph[q][a][p] = -1;
-            }
-        }
+    tg->setWords = 0;
+    tg->rowOffset = NULL;
+    tg->edges = NULL;
+    tg->denseRow = NULL;
+    tg->denseMasks = NULL;
+    tg->edgeCount = 0;
+    tg->denseCount = 0;
+    tg->acceptingStates = NULL;
+    tg->acceptingMask = NULL;
+    tg->minAccept = NULL;
+    tg->maxAccept = NULL;
+    tg->minReject = NULL;
+    tg->maxReject = NULL;
+    tg->nonEmptyRows = 0;
+    tg->branching = 0.0;
+    tg->universalRatio = 0.0;
+    tg->treeCounts = NULL;
+    tg->treeFrontier = NULL;
+    tg->stepTables = NULL;
+    tg->stepMasks = NULL;
+    tg->stepChunks = 0;
+    tg->stepStride = 0;
+    tg->stepKernel = NULL;
+    tg->stepBack = NULL;
+    tg->bitsetAccept = NULL;
+    tg->variantWords = 0;
+    tg->image = NULL;
+    tg->imageSize = 0;
+    for(int a=0;a<256;++a) {
+        tg->letterClass[a] = -1;
     }
 }
 
 /**
- * Creates new initialized and empty transition graph.
- * 
- * @returns New empty transition graph
+ * Sets the header of the graph and allocates (empty) set of accepting states.
+ * All previously loaded transitions and accepting states are removed.
+ *
+ * @param[in] tg : Transition graph
+ * @param[in] A  : Size of the alphabet
+ * @param[in] Q  : Number of states
+ * @param[in] U  : Number of universal states
+ * @param[in] F  : Number of final states
+ * @param[in] q0 : Initial state
  */
-TransitionGraph newTransitionGraph() {
-    TransitionGraph tg = MALLOCATE(TransitionGraphImpl);
-    initTransitionGraph(tg);
-    return tg;
+void setTransitionGraphHeader(TransitionGraph tg, int A, int Q, int U, int F, int q0) {
+    FREE(tg->acceptingStates);
+    FREE(tg->acceptingMask);
+    
+    tg->A = A;
+    tg->Q = Q;
+    tg->U = U;
+    tg->F = F;
+    tg->q0 = q0;
+    tg->setWords = stateSetWords(Q);
+    tg->acceptingStates = MALLOCATE_ARRAY(char, Q > 0 ? Q : 1);
+    tg->acceptingMask = MALLOCATE_ARRAY(uint64_t, tg->setWords > 0 ? tg->setWords : 1);
 }
 
-/**
- * Loads transition graph textual representation from standard input.
- * For details on valid textual representation of transition graph see: loadTransitionGraph docs.
- * 
- * NOTE: Returned array must be freed.
+/*
+ * Helper function for setTransitionGraphEdges
+ * Builds the step tables (see automaton_simd.h) unless they exceed STEP_TABLES_MEMORY_LIMIT.
  *
- * @returns Loaded allocated array with textual graph representation
+ * For the letter class c and chunk k the row b of the table is the set of states
+ * having a successor by c in the subset b of the states 8k..8k+7.
  */
-char* loadTransitionGraphDescFromStdin() {
-    char buffer[FILE_BUF_SIZE];
-    size_t contentSize = 1;
-    char *content = MALLOCATE_ARRAY(char, FILE_BUF_SIZE);
-    if(content == NULL) {
-        syserr("Failed to allocate content");
+static void buildTransitionGraphStepTables(TransitionGraph tg) {
+    FREE(tg->stepTables);
+    FREE(tg->stepMasks);
+    tg->stepTables = NULL;
+    tg->stepMasks = NULL;
+    tg->stepKernel = NULL;
+    
+#if USE_STEP_TABLES == 1
+    const int words = tg->setWords;
+    const int chunks = (tg->Q + 7) / 8;
+    tg->stepKernel = selectStepKernel(words, STEP_KERNEL_MAX_LANES);
+    const int lanes = tg->stepKernel->lanes;
+    const int stride = (words + lanes - 1) / lanes * lanes;
+    const size_t class_size = (size_t) chunks * 256 * stride;
+    
+    if(tg->C == 0 || (double) class_size * tg->C * sizeof(uint64_t) > STEP_TABLES_MEMORY_LIMIT) {
+        tg->stepKernel = NULL;
+        return;
     }
-    content[0] = '\0';
-    while(fgets(buffer, FILE_BUF_SIZE, stdin)) {
-        contentSize += strlen(buffer);
-        content = MREALLOCATE_ARRAY(char, contentSize, content);
-        if(content == NULL) {
-            syserr("Failed to reallocate content");
+    
+    tg->stepChunks = chunks;
+    tg->stepStride = stride;
+    tg->stepTables = MALLOCATE_ARRAY(uint64_t, class_size * tg->C);
+    tg->stepMasks = MALLOCATE_ARRAY(uint64_t, 2 * stride);
+    
+    for(int c=0;c<tg->C;++c) {
+        uint64_t* table = &(tg->stepTables[c * class_size]);
+        
+        // Single state subsets: predecessors of the state
+        for(int q=0;q<tg->Q;++q) {
+            const int count = transitionCount(tg, q, c);
+            const int* targets = transitionTargets(tg, q, c);
+            for(int i=0;i<count;++i) {
+                const int p = targets[i];
+                stateSetAdd(&table[((size_t) (p / 8) * 256 + (1 << (p % 8))) * stride], q);
+            }
+        }
+        
+        // Other subsets: union of the subset without its lowest state and the lowest state
+        for(int k=0;k<chunks;++k) {
+            uint64_t* chunk = &table[(size_t) k * 256 * stride];
+            for(int b=3;b<256;++b) {
+                const int low = b & (-b);
+                if(low != b) {
+                    for(int w=0;w<stride;++w) {
+                        chunk[b * stride + w] = chunk[(b - low) * stride + w] | chunk[low * stride + w];
+                    }
+                }
+            }
         }
-        strcat(content, buffer);
     }
+    
+    for(int q=0;q<tg->Q;++q) {
+        stateSetAdd(&(tg->stepMasks[(q >= tg->U) ? 0 : stride]), q);
+    }
+    log(AUTOMATON, "Step tables: %d chunks, %s kernel", chunks, tg->stepKernel->name);
+#endif
+}
 
-    if(ferror(stdin)) {
-        FREE(content);
-        syserr("Error reading from stdin.");
+void stateSetStepBackDynamic(TransitionGraph tg, const uint64_t* next, int c, StateSet out);
+int acceptBitsetDynamic(TransitionGraph tg, char* word);
+
+/*
+ * Defines the backward step (stateSetStepBack_W_K) and the bitset accept (acceptBitset_W_K)
+ * specialized for sets of exactly W words, so for Q <= 64*W, and for the step kernel K (see automaton_simd.h).
+ *
+ * The sets have fixed-width types, so all the loops over the words have constant bounds and are
+ * unrolled by the compiler, the sets are kept in registers and no variable length arrays are needed.
+ * The step reads the step tables (see buildTransitionGraphStepTables) with stepStride equal to W.
+ * The kernel is inlined with the constant stride, so both functions are compiled for the instruction set
+ * of the kernel (TARGET attribute, empty for the scalar one).
+ */
+#define DEFINE_FIXED_WIDTH_ENGINES(W, K, TARGET) \
+TARGET static void stateSetStepBack_##W##_##K(TransitionGraph tg, const uint64_t* next, int c, StateSet out) { \
+    const uint64_t* existential = tg->stepMasks; \
+    const uint64_t* universal = &(tg->stepMasks[W]); \
+    if(c < 0 || c >= tg->C) { \
+        for(int w=0;w<W;++w) { \
+            out[w] = universal[w]; \
+        } \
+        return; \
+    } \
+    uint64_t in[W]; \
+    uint64_t not_in[W]; \
+    stepKernel##K(&(tg->stepTables[(size_t) c * tg->stepChunks * 256 * W]), tg->stepChunks, W, next, in, not_in); \
+    for(int w=0;w<W;++w) { \
+        out[w] = (in[w] & existential[w]) | (universal[w] & ~not_in[w]); \
+    } \
+} \
+TARGET static int acceptBitset_##W##_##K(TransitionGraph tg, char* word) { \
+    uint64_t sets[2][W]; \
+    int current = 0; \
+    for(int w=0;w<W;++w) { \
+        sets[current][w] = tg->acceptingMask[w]; \
+    } \
+    for(int i=strlen(word)-1;i>=0;--i) { \
+        stateSetStepBack_##W##_##K(tg, sets[current], letterClassOf(tg, word[i]), sets[!current]); \
+        current = !current; \
+    } \
+    return stateSetHas(sets[current], tg->q0); \
+}
+
+DEFINE_FIXED_WIDTH_ENGINES(1, Scalar, )
+DEFINE_FIXED_WIDTH_ENGINES(2, Scalar, )
+DEFINE_FIXED_WIDTH_ENGINES(4, Scalar, )
+#if STEP_KERNELS_X86 == 1
+DEFINE_FIXED_WIDTH_ENGINES(2, SSE2, __attribute__((target("sse2"))))
+DEFINE_FIXED_WIDTH_ENGINES(4, SSE2, __attribute__((target("sse2"))))
+DEFINE_FIXED_WIDTH_ENGINES(4, AVX2, __attribute__((target("avx2"))))
+#endif
+
+/*
+ * Structure to describe the fixed-width engines (see DEFINE_FIXED_WIDTH_ENGINES)
+ */
+typedef struct TransitionGraphVariant {
+    int words;                   ///< width of the sets
+    StepKernel kernel;           ///< step kernel inlined into the engines
+    StateSetStepFn stepBack;     ///< backward step
+    AcceptVariantFn bitsetAccept; ///< bitset accept
+} TransitionGraphVariant;
+
+/*
+ * Fixed-width engines
+ */
+static const TransitionGraphVariant transitionGraphVariants[] = {
+    { 1, stepKernelScalar, stateSetStepBack_1_Scalar, acceptBitset_1_Scalar },
+    { 2, stepKernelScalar, stateSetStepBack_2_Scalar, acceptBitset_2_Scalar },
+    { 4, stepKernelScalar, stateSetStepBack_4_Scalar, acceptBitset_4_Scalar },
+#if STEP_KERNELS_X86 == 1
+    { 2, stepKernelSSE2,   stateSetStepBack_2_SSE2,   acceptBitset_2_SSE2 },
+    { 4, stepKernelSSE2,   stateSetStepBack_4_SSE2,   acceptBitset_4_SSE2 },
+    { 4, stepKernelAVX2,   stateSetStepBack_4_AVX2,   acceptBitset_4_AVX2 },
+#endif
+};
+
+/*
+ * Helper function for setTransitionGraphEdges
+ * Picks the engines specialized for the number of states (Q <= 64, Q <= 128, Q <= 256)
+ * and the step kernel selected for the step tables, or the dynamic ones for larger automata
+ * (and when the step tables were not built).
+ */
+static void selectTransitionGraphVariant(TransitionGraph tg) {
+    tg->stepBack = stateSetStepBackDynamic;
+    tg->bitsetAccept = acceptBitsetDynamic;
+    tg->variantWords = 0;
+    
+#if USE_FIXED_WIDTH_ENGINES == 1
+    if(tg->stepTables == NULL || tg->stepStride != tg->setWords) {
+        return;
+    }
+    const int count = sizeof(transitionGraphVariants) / sizeof(transitionGraphVariants[0]);
+    for(int i=0;i<count;++i) {
+        if(transitionGraphVariants[i].words == tg->setWords && transitionGraphVariants[i].kernel == tg->stepKernel->kernel) {
+            tg->stepBack = transitionGraphVariants[i].stepBack;
+            tg->bitsetAccept = transitionGraphVariants[i].bitsetAccept;
+            tg->variantWords = tg->setWords;
+            log(AUTOMATON, "Engines specialized for Q <= %d (%s kernel)", 64 * tg->variantWords, tg->stepKernel->name);
+            return;
+        }
+    }
+#endif
+}
+
+/*
+ * Helper function for setTransitionGraphEdges and openTransitionGraphImage
+ * Calculates the statistics used to estimate the size of the run (see acceptAsync and acceptEngineEstimate)
+ * and allocates the scratch buffers of estimateRunTree, so neither is redone for every word.
+ */
+static void transitionGraphStatistics(TransitionGraph tg) {
+    const int rows = tg->Q * tg->C;
+    tg->nonEmptyRows = 0;
+    for(int r=0;r<rows;++r) {
+        tg->nonEmptyRows += (tg->rowOffset[r+1] > tg->rowOffset[r]);
     }
+    tg->branching = (tg->nonEmptyRows > 0) ? (double) tg->edgeCount / tg->nonEmptyRows : 0.0;
+    tg->universalRatio = (tg->Q > 0) ? (double) tg->U / tg->Q : 0.0;
     
-    return content;
+    FREE(tg->treeCounts);
+    FREE(tg->treeFrontier);
+    tg->treeCounts = MALLOCATE_ARRAY(double, tg->Q > 0 ? 2 * tg->Q : 1);
+    tg->treeFrontier = MALLOCATE_ARRAY(int, tg->Q > 0 ? 2 * tg->Q : 1);
 }
 
 /**
- * Loads transition graph textual representation from the given file.
- * For details on valid textual representation of transition graph see: loadTransitionGraph docs.
+ * Sets the transitions of the graph and groups the letters into classes.
+ * The graph header (see setTransitionGraphHeader) and accepting states must be already set.
  *
- * NOTE: Returned array must be freed.
+ * The transitions are given as the list of (row, target) pairs, where row = q*A+a (a is letter index),
+ * meaning that there's edge q -> target by letter a.
+ * Successors of each (q,a) keep the order from the input list.
  *
- * @param[in] input : Input file
- * @returns Loaded allocated array with textual graph representation
+ * Letters a and b get the same class iff for every state the lists of successors by a and b are equal.
+ * Only one row per (state, class) pair is stored.
+ *
+ * @param[in] tg           : Transition graph
+ * @param[in] edge_rows    : Rows of the edges
+ * @param[in] edge_targets : Targets of the edges
+ * @param[in] edge_count   : Number of the edges
  */
-char* loadTransitionGraphDescFromFile(FILE* input) {
-    fseek(input, 0, SEEK_END);
-    long fsize = ftell(input);
+void setTransitionGraphEdges(TransitionGraph tg, const int* edge_rows, const int* edge_targets, int edge_count) {
+    const int Q = tg->Q;
+    const int A = tg->A;
+    const int letter_row_count = Q * A;
     
-    fseek(input, 0, SEEK_SET);
-    char *buff = MALLOCATE_BLOCKS(1, fsize + 1);
+    FREE(tg->rowOffset);
+    FREE(tg->edges);
+    FREE(tg->denseRow);
+    FREE(tg->denseMasks);
     
-    fread(buff, fsize, 1, input);
-    fclose(input);
+    // Counting sort of the edges by (q,a) rows
+    int* letter_offset = MALLOCATE_ARRAY(int, letter_row_count + 1);
+    int* letter_edges = MALLOCATE_ARRAY(int, edge_count > 0 ? edge_count : 1);
+    for(int row=0;row<=letter_row_count;++row) {
+        letter_offset[row] = 0;
+    }
+    for(int i=0;i<edge_count;++i) {
+        ++(letter_offset[edge_rows[i] + 1]);
+    }
+    for(int row=0;row<letter_row_count;++row) {
+        letter_offset[row + 1] += letter_offset[row];
+    }
+    int* fill = MALLOCATE_ARRAY(int, letter_row_count > 0 ? letter_row_count : 1);
+    for(int row=0;row<letter_row_count;++row) {
+        fill[row] = letter_offset[row];
+    }
+    for(int i=0;i<edge_count;++i) {
+        letter_edges[fill[edge_rows[i]]++] = edge_targets[i];
+    }
+    FREE(fill);
     
-    buff[fsize] = 0;
-    return buff;
+    // Group the letters with equal successors in every state (the column hash is compared first)
+    uint64_t class_hash[256];
+    int class_letter[256];
+    tg->C = 0;
+    for(int a=0;a<256;++a) {
+        tg->letterClass[a] = -1;
+    }
+    for(int a=0;a<A;++a) {
+        uint64_t hash = 14695981039346656037ULL;
+        int has_edges = 0;
+        for(int q=0;q<Q;++q) {
+            const int row = q * A + a;
+            hash = (hash ^ (uint32_t)(letter_offset[row + 1] - letter_offset[row])) * 1099511628211ULL;
+            for(int i=letter_offset[row];i<letter_offset[row + 1];++i) {
+                hash = (hash ^ (uint32_t) letter_edges[i]) * 1099511628211ULL;
+                has_edges = 1;
+            }
+        }
+        if(!has_edges) {
+            continue;
+        }
+        for(int c=0;c<tg->C && tg->letterClass[a] == -1;++c) {
+            if(class_hash[c] != hash) continue;
+            const int b = class_letter[c];
+            int equal = 1;
+            for(int q=0;q<Q && equal;++q) {
+                const int row_a = q * A + a;
+                const int row_b = q * A + b;
+                const int size = letter_offset[row_a + 1] - letter_offset[row_a];
+                equal = (size == letter_offset[row_b + 1] - letter_offset[row_b])
+                    && memcmp(&letter_edges[letter_offset[row_a]], &letter_edges[letter_offset[row_b]], size * sizeof(int)) == 0;
+            }
+            if(equal) {
+                tg->letterClass[a] = c;
+            }
+        }
+        if(tg->letterClass[a] == -1) {
+            class_hash[tg->C] = hash;
+            class_letter[tg->C] = a;
+            tg->letterClass[a] = tg->C++;
+        }
+    }
+    
+    // Rows of the classes (the ones of the first letter of each class)
+    const int C = tg->C;
+    const int row_count = Q * C;
+    tg->rowOffset = MALLOCATE_ARRAY(int, row_count + 1);
+    tg->edgeCount = 0;
+    for(int q=0;q<Q;++q) {
+        for(int c=0;c<C;++c) {
+            const int letter_row = q * A + class_letter[c];
+            tg->rowOffset[q * C + c] = tg->edgeCount;
+            tg->edgeCount += letter_offset[letter_row + 1] - letter_offset[letter_row];
+        }
+    }
+    tg->rowOffset[row_count] = tg->edgeCount;
+    tg->edges = MALLOCATE_ARRAY(int, tg->edgeCount > 0 ? tg->edgeCount : 1);
+    for(int q=0;q<Q;++q) {
+        for(int c=0;c<C;++c) {
+            const int letter_row = q * A + class_letter[c];
+            const int size = letter_offset[letter_row + 1] - letter_offset[letter_row];
+            memcpy(&(tg->edges[tg->rowOffset[q * C + c]]), &letter_edges[letter_offset[letter_row]], size * sizeof(int));
+        }
+    }
+    FREE(letter_offset);
+    FREE(letter_edges);
+    tg->denseRow = MALLOCATE_ARRAY(int, row_count > 0 ? row_count : 1);
+    
+    // Rows for which bitset is no greater than the list of successors are dense
+    const int words = tg->setWords;
+    tg->denseCount = 0;
+    for(int row=0;row<row_count;++row) {
+        const int size = tg->rowOffset[row + 1] - tg->rowOffset[row];
+        if(size > 0 && size * sizeof(int) >= words * sizeof(uint64_t)) {
+            tg->denseRow[row] = tg->denseCount++;
+        } else {
+            tg->denseRow[row] = -1;
+        }
+    }
+    tg->denseMasks = MALLOCATE_ARRAY(uint64_t, tg->denseCount > 0 ? tg->denseCount * words : 1);
+    for(int row=0;row<row_count;++row) {
+        if(tg->denseRow[row] != -1) {
+            StateSet mask = &(tg->denseMasks[tg->denseRow[row] * words]);
+            stateSetClear(mask, words);
+            for(int i=tg->rowOffset[row];i<tg->rowOffset[row + 1];++i) {
+                stateSetAdd(mask, tg->edges[i]);
+            }
+        }
+    }
+    
+    stateSetClear(tg->acceptingMask, words);
+    for(int q=0;q<tg->Q;++q) {
+        if(tg->acceptingStates[q]) {
+            stateSetAdd(tg->acceptingMask, q);
+        }
+    }
+    
+    buildTransitionGraphStepTables(tg);
+    selectTransitionGraphVariant(tg);
+    transitionGraphStatistics(tg);
 }
 
 /**
- * Reads the transition graph from the given text array.
+ * Helper function for analyseTransitionGraph.
  *
- * Valid graph format is:
+ * Calculates bounds of the lengths of words accepted (polarity 1) or rejected (polarity 0) from each state.
+ * For acceptance goal states are the final ones, existential states need one successor and
+ * universal states need all successors of the letter (the roles are swapped for rejection).
+ * The bounds are sound: each state can accept (reject) only words of length between min_dist and max_dist,
+ * if min_dist is INT_MAX then no word is accepted (rejected).
  *
- *   N A Q U F\n
- *   q\n
- *   [q]\n
- *   [q a r [p]\n]
- *   
- *   where
- *     N is the number of lines of the input;
- *     A is the size of the alphabet: the alphabet is the set {a,...,x}, where 'x'-'a' = A-1;
- *     Q is the number of states: the states are the set {0,...,Q-1};
- *     U is the number of universal states: universal states = {0, .., U-1}, existential states = {U, .., Q-1};
- *     F is the number of final states;
- *     q, r, p denotes some states
- *     and a is a letter of the alphabet
+ * The lower bound is computed in increasing order of values (like BFS) on reversed edges.
+ * The upper bound is the longest path to the goal among states with finite lower bound
+ * (INT_MAX if the path can be pumped through a cycle or can end in a state that needs all successors
+ * of a letter without successors).
  *
- *  NOTE:
- *     A sequence [wyr] denotes that the string wyr repeats a finite (greater than or equal to 0) number of times.
- * 
- * @param[in] input : Input text
- * @param[in] tg    : Transition graph to be set
+ * Letters of the alphabet without any transitions (class -1) are taken into account as one more
+ * letter class with all the rows empty, so the bounds hold for all the words over the alphabet (see wordInAlphabet).
+ *
+ * @param[in]  tg         : Transition graph
+ * @param[in]  pred_start : pred_start[r] is position of the first predecessor row of state r in pred_rows (Q+1 entries)
+ * @param[in]  pred_rows  : Rows (q*C+c) of the edges leading to each state
+ * @param[in]  polarity   : 1 to bound accepted words, 0 to bound rejected words
+ * @param[out] min_dist   : Lower bounds (Q entries)
+ * @param[out] max_dist   : Upper bounds (Q entries)
  */
-void loadTransitionGraph(char** input, TransitionGraph tg) {
-    
-    if(input == NULL) return;
+static void transitionGraphBounds(TransitionGraph tg, const int* pred_start, const int* pred_rows, int polarity, int* min_dist, int* max_dist) {
+    const int Q = tg->Q;
+    const int C = tg->C;
+    int* queue = MALLOCATE_ARRAY(int, Q);
+    int* left = MALLOCATE_ARRAY(int, Q * C > 0 ? Q * C : 1);
+    int* out_degree = MALLOCATE_ARRAY(int, Q);
+    int head = 0;
+    int tail = 0;
     
-    int N;
-    int q;
-    char a;
-    int pos;
-    int npos;
-    int r;
-    char* line_buf = MALLOCATE_ARRAY(char, LINE_BUF_SIZE);
-    size_t line_buf_size = LINE_BUF_SIZE;
+    // Letter of the alphabet without transitions: empty row of every state
+    int empty_letter = 0;
+    for(int a=0;a<tg->A && a<256;++a) {
+        empty_letter |= (tg->letterClass[a] == -1);
+    }
     
-    char** line_buf_p = &line_buf;
-    size_t* line_buf_s = &line_buf_size;
+    // The states that need all successors (universal for acceptance)
+    #define BOUNDS_NEEDS_ALL(q) (((q) < tg->U) == (polarity == 1))
     
-    strGetline(line_buf_p, line_buf_s, input);
-    sscanf(line_buf, "%d %d %d %d %d", &N, &(tg->A), &(tg->Q), &(tg->U), &(tg->F));
+    for(int q=0;q<Q;++q) {
+        min_dist[q] = INT_MAX;
+        if(tg->acceptingStates[q] == polarity) {
+            min_dist[q] = 0;
+            queue[tail++] = q;
+        }
+    }
+    for(int q=0;q<Q;++q) {
+        for(int c=0;c<C;++c) {
+            left[q * C + c] = transitionCount(tg, q, c);
+            if(left[q * C + c] == 0 && BOUNDS_NEEDS_ALL(q) && min_dist[q] == INT_MAX) {
+                min_dist[q] = 1;
+                queue[tail++] = q;
+            }
+        }
+        if(empty_letter && BOUNDS_NEEDS_ALL(q) && min_dist[q] == INT_MAX) {
+            min_dist[q] = 1;
+            queue[tail++] = q;
+        }
+    }
     
-    strGetline(line_buf_p, line_buf_s, input);
-    sscanf(line_buf, "%d", &(tg->q0));
+    // Lower bound: the states are settled in nondecreasing order of the bound
+    while(head < tail) {
+        const int r = queue[head++];
+        for(int i=pred_start[r];i<pred_start[r+1];++i) {
+            const int row = pred_rows[i];
+            const int q = row / C;
+            if(min_dist[q] != INT_MAX) {
+                continue;
+            }
+            if(!BOUNDS_NEEDS_ALL(q) || --left[row] == 0) {
+                min_dist[q] = min_dist[r] + 1;
+                queue[tail++] = q;
+            }
+        }
+    }
     
-    strGetline(line_buf_p, line_buf_s, input);
-    pos = 0;
-    for(int i=0;i<tg->F;++i) {
-        sscanf(line_buf+pos, "%d%n", &q, &npos);
-        tg->acceptingStates[q] = 1;
-        pos += npos;
+    // Upper bound: longest path to the goal (states are processed when all their successors are done)
+    head = 0;
+    tail = 0;
+    for(int q=0;q<Q;++q) {
+        out_degree[q] = 0;
+        max_dist[q] = INT_MAX;
+        if(min_dist[q] == INT_MAX) {
+            continue;
+        }
+        int has_empty_row = empty_letter;
+        for(int c=0;c<C;++c) {
+            const int size = transitionCount(tg, q, c);
+            const int* targets = transitionTargets(tg, q, c);
+            has_empty_row |= (size == 0);
+            for(int i=0;i<size;++i) {
+                out_degree[q] += (min_dist[targets[i]] != INT_MAX);
+            }
+        }
+        if(has_empty_row && BOUNDS_NEEDS_ALL(q)) {
+            // Any continuation by such letter is fine, so there's no upper bound
+            out_degree[q] = -1;
+            continue;
+        }
+        max_dist[q] = (tg->acceptingStates[q] == polarity) ? 0 : -1;
+        if(out_degree[q] == 0) {
+            queue[tail++] = q;
+        }
     }
-
-    while(1) {
-       int getline_size = strGetline(line_buf_p, line_buf_s, input);
-       if(getline_size == -1) break;
-
-       if(getline_size > 0) {
-           if(!sscanf(line_buf, "%d %c%n", &q, &a, &pos)) {
-               continue;
-           }
-           if(*((char*)(line_buf+pos)) == '\0') break;
-           while(sscanf(line_buf+pos, "%d%n", &r, &npos)) {
-               pos += npos;
-               
-               tg->graph[q][(int)(a-'a')][tg->size[q][(int)(a-'a')]++] = r;
-               if(*((char*)(line_buf+pos)) == '\0') break;
-           }
-       }
+    
+    #undef BOUNDS_NEEDS_ALL
+    
+    while(head < tail) {
+        const int r = queue[head++];
+        for(int i=pred_start[r];i<pred_start[r+1];++i) {
+            const int q = pred_rows[i] / C;
+            if(out_degree[q] <= 0) {
+                continue;
+            }
+            if(max_dist[r] == INT_MAX) {
+                max_dist[q] = INT_MAX;
+            } else if(max_dist[q] != INT_MAX && max_dist[r] + 1 > max_dist[q]) {
+                max_dist[q] = max_dist[r] + 1;
+            }
+            if(--out_degree[q] == 0) {
+                queue[tail++] = q;
+            }
+        }
     }
     
-    FREE(line_buf);
+    // States that were not processed lie on (or lead to) a cycle
+    for(int q=0;q<Q;++q) {
+        if(out_degree[q] > 0) {
+            max_dist[q] = INT_MAX;
+        }
+    }
     
+    FREE(queue);
+    FREE(left);
+    FREE(out_degree);
 }
 
-
-
 /**
- * Helper function for acceptSync.
- * Recursively calculates accept() on the transition graph nodes.
- * 
- * @param [in] tg            : Transition graph
- * @param [in] word          : Input word
- * @param [in] word_len      : Input word size
- * @param [in] current_state : Current state of the automaton
- * @param [in] depth         : Position in word correlated with the current state
- * @return Is the word accepted by automaton defined by transition graph?
+ * Analyses the loaded transition graph.
+ *
+ * For each state calculates bounds of the lengths of the words it can accept and reject
+ * (see TransitionGraphImpl minAccept, maxAccept, minReject, maxReject fields).
+ * States with minAccept equal to INT_MAX are dead (they reject every word), states with minReject
+ * equal to INT_MAX accept every word. The engines use it to skip subtrees of the run (see acceptPrune).
+ *
+ * This function is called by loadTransitionGraph.
+ *
+ * @param[in] tg : Transition graph
  */
-int acceptSync_rec(TransitionGraph tg, char* word, int word_len, int current_state, int depth) {
+void analyseTransitionGraph(TransitionGraph tg) {
+    const int Q = tg->Q;
+    const int row_count = Q * tg->C;
     
-    if(depth >= word_len) {
-        return tg->acceptingStates[current_state];
+    FREE(tg->minAccept);
+    FREE(tg->maxAccept);
+    FREE(tg->minReject);
+    FREE(tg->maxReject);
+    tg->minAccept = MALLOCATE_ARRAY(int, Q);
+    tg->maxAccept = MALLOCATE_ARRAY(int, Q);
+    tg->minReject = MALLOCATE_ARRAY(int, Q);
+    tg->maxReject = MALLOCATE_ARRAY(int, Q);
+    
+    // Reversed edges (rows leading to each state)
+    int* pred_start = MALLOCATE_ARRAY(int, Q + 1);
+    int* pred_rows = MALLOCATE_ARRAY(int, tg->edgeCount > 0 ? tg->edgeCount : 1);
+    for(int r=0;r<=Q;++r) {
+        pred_start[r] = 0;
+    }
+    for(int i=0;i<tg->edgeCount;++i) {
+        ++pred_start[tg->edges[i] + 1];
+    }
+    for(int r=0;r<Q;++r) {
+        pred_start[r + 1] += pred_start[r];
+    }
+    int* fill = MALLOCATE_ARRAY(int, Q);
+    for(int r=0;r<Q;++r) {
+        fill[r] = pred_start[r];
+    }
+    for(int row=0;row<row_count;++row) {
+        for(int i=tg->rowOffset[row];i<tg->rowOffset[row + 1];++i) {
+            pred_rows[fill[tg->edges[i]]++] = row;
+        }
     }
+    FREE(fill);
     
-#if DEBUG_ACCEPT_RUN == 1    
-    log_warn(RUN, "At state %d in word {%s} at pos {%d/%d}", current_state, word, depth, word_len);
-#endif
+    transitionGraphBounds(tg, pred_start, pred_rows, 1, tg->minAccept, tg->maxAccept);
+    transitionGraphBounds(tg, pred_start, pred_rows, 0, tg->minReject, tg->maxReject);
     
-    const int current_letter = (int)(word[depth] - 'a');
-    const int branch_count = tg->size[current_state][current_letter];
+    FREE(pred_start);
+    FREE(pred_rows);
     
-    if(current_state >= tg->U) {
-        // Existential state
-        for(int i=0;i<branch_count;++i) {
-            if(acceptSync_rec(tg, word, word_len, tg->graph[current_state][current_letter][i], depth+1)) {
-                return 1;
+    int dead_count = 0;
+    int accepting_count = 0;
+    for(int q=0;q<Q;++q) {
+        dead_count += (tg->minAccept[q] == INT_MAX);
+        accepting_count += (tg->minReject[q] == INT_MAX);
+    }
+    log(AUTOMATON, "Analysis: %d dead states, %d states accepting every word", dead_count, accepting_count);
+}
+
+/**
+ * Checks if the result of the run from the given state is known from the analysis
+ * (see analyseTransitionGraph).
+ *
+ * Must be used only for words over the alphabet (see wordInAlphabet).
+ *
+ * Returns:
+ *   *  1 if the state accepts all words of the given length
+ *   *  0 if the state rejects all words of the given length
+ *   * -1 if the result is not known
+ *
+ * @param[in] tg        : Transition graph
+ * @param[in] q         : State
+ * @param[in] remaining : Length of the remaining part of the word
+ * @returns Known result or -1
+ */
+static inline int acceptPrune(const TransitionGraph tg, int q, int remaining) {
+    if(remaining < tg->minAccept[q] || remaining > tg->maxAccept[q]) {
+        return 0;
+    }
+    if(remaining < tg->minReject[q] || remaining > tg->maxReject[q]) {
+        return 1;
+    }
+    return -1;
+}
+
+/**
+ * Checks if all the letters of the word belong to the alphabet (the letters without transitions included,
+ * see transitionGraphBounds) and the graph was analysed, so acceptPrune can be used for the word.
+ *
+ * @param[in] tg       : Transition graph
+ * @param[in] word     : Input word
+ * @param[in] word_len : Input word size
+ * @returns If acceptPrune can be used?
+ */
+static inline int wordInAlphabet(const TransitionGraph tg, const char* word, int word_len) {
+    if(tg->minAccept == NULL) {
+        return 0;
+    }
+    for(int i=0;i<word_len;++i) {
+        if(letterIndex(word[i]) >= tg->A) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Frees the transition graph.
+ *
+ * @param[in] tg : Transition graph
+ */
+void freeTransitionGraph(TransitionGraph tg) {
+    FREE(tg->treeCounts);
+    FREE(tg->treeFrontier);
+    if(tg->image != NULL) {
+        // The arrays belong to the image (see automaton_image.h)
+        FREE(tg);
+        return;
+    }
+    FREE(tg->acceptingStates);
+    FREE(tg->acceptingMask);
+    FREE(tg->rowOffset);
+    FREE(tg->edges);
+    FREE(tg->denseRow);
+    FREE(tg->denseMasks);
+    FREE(tg->minAccept);
+    FREE(tg->maxAccept);
+    FREE(tg->minReject);
+    FREE(tg->maxReject);
+    FREE(tg->stepTables);
+    FREE(tg->stepMasks);
+    FREE(tg);
+}
+
+/**
+ * Calculates 64-bit FNV-1a checksum of the transition graph contents.
+ * Two graphs with the same header, transitions and accepting states have equal checksums.
+ *
+ * @param[in] tg : Transition graph
+ * @returns Checksum of the graph
+ */
+uint64_t transitionGraphChecksum(const TransitionGraph tg) {
+    uint64_t hash = 14695981039346656037ULL;
+    const int header[6] = { tg->A, tg->C, tg->Q, tg->U, tg->F, tg->q0 };
+    const int* chunks[4] = { header, tg->letterClass, tg->rowOffset, tg->edges };
+    const int chunk_len[4] = { 6, 256, tg->Q * tg->C + 1, tg->edgeCount };
+
+    for(int c=0;c<4;++c) {
+        for(int i=0;i<chunk_len[c];++i) {
+            uint32_t v = (uint32_t) chunks[c][i];
+            for(int b=0;b<4;++b) {
+                hash = (hash ^ ((v >> (8*b)) & 0xFF)) * 1099511628211ULL;
+            }
+        }
+    }
+    for(int q=0;q<tg->Q;++q) {
+        hash = (hash ^ (unsigned char) tg->acceptingStates[q]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Creates new initialized and empty transition graph.
+ * 
+ * @returns New empty transition graph
+ */
+TransitionGraph newTransitionGraph() {
+    TransitionGraph tg = MALLOCATE(TransitionGraphImpl);
+    initTransitionGraph(tg);
+    return tg;
+}
+
+/**
+ * Loads transition graph textual representation from standard input.
+ * For details on valid textual representation of transition graph see: loadTransitionGraph docs.
+ *
+ * The input is read in blocks of STDIN_READ_BLOCK_SIZE bytes into the buffer growing geometrically,
+ * so the loading is linear in the input size. If the standard input is a regular file
+ * the buffer is sized from the file at once.
+ *
+ * The sizes are size_t, so the description can exceed 2 GiB: the buffer is allocated with malloc/realloc
+ * (MALLOCATE_ARRAY takes int counts), but it's registered in the GC like the MALLOCATE ones.
+ * 
+ * NOTE: Returned array must be freed (with FREE).
+ *
+ * @returns Loaded allocated array with textual graph representation
+ */
+char* loadTransitionGraphDescFromStdin() {
+    size_t capacity = STDIN_READ_BLOCK_SIZE;
+    struct stat input_stat;
+    if(fstat(fileno(stdin), &input_stat) == 0 && S_ISREG(input_stat.st_mode) && input_stat.st_size > 0) {
+        capacity = (size_t) input_stat.st_size + 1;
+    }
+    
+    size_t contentSize = 0;
+    char *content = (char*) malloc(capacity);
+    if(content == NULL) {
+        syserr("Failed to allocate content");
+    }
+    GC_ON_ALLOC(content);
+    while(1) {
+        if(capacity - contentSize <= 1) {
+            if(capacity > SIZE_MAX / 2) {
+                fatal(AUTOMATON, "Automaton description on stdin is too large");
+            }
+            capacity *= 2;
+            char* grown = (char*) realloc(content, capacity);
+            if(grown == NULL) {
+                syserr("Failed to reallocate content of %zu bytes", capacity);
+            }
+            GC_ON_FREE(content);
+            GC_ON_ALLOC(grown);
+            content = grown;
+        }
+        size_t block = capacity - contentSize - 1;
+        if(block > STDIN_READ_BLOCK_SIZE) {
+            block = STDIN_READ_BLOCK_SIZE;
+        }
+        const size_t read_len = fread(content + contentSize, 1, block, stdin);
+        contentSize += read_len;
+        if(read_len < block) {
+            break;
+        }
+    }
+    content[contentSize] = '\0';
+
+    if(ferror(stdin)) {
+        FREE(content);
+        syserr("Error reading from stdin.");
+    }
+    
+    return content;
+}
+
+/**
+ * Loads transition graph textual representation from the given file.
+ * For details on valid textual representation of transition graph see: loadTransitionGraph docs.
+ *
+ * NOTE: Returned array must be freed.
+ *
+ * @param[in] input : Input file
+ * @returns Loaded allocated array with textual graph representation
+ */
+char* loadTransitionGraphDescFromFile(FILE* input) {
+    fseek(input, 0, SEEK_END);
+    long fsize = ftell(input);
+    
+    fseek(input, 0, SEEK_SET);
+    char *buff = MALLOCATE_BLOCKS(1, fsize + 1);
+    
+    fread(buff, fsize, 1, input);
+    fclose(input);
+    
+    buff[fsize] = 0;
+    return buff;
+}
+
+/*
+ * Helper function for loadTransitionGraph
+ * Skips the spaces (but not the end of the line).
+ */
+static inline const char* transitionGraphSkipSpaces(const char* p) {
+    while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\v' || *p == '\f') {
+        ++p;
+    }
+    return p;
+}
+
+/*
+ * Helper function for loadTransitionGraph
+ * Returns the beginning of the next line (or the end of the text).
+ */
+static inline const char* transitionGraphSkipLine(const char* p) {
+    while(*p != '\n' && *p != '\0') {
+        ++p;
+    }
+    return (*p == '\n') ? p + 1 : p;
+}
+
+/*
+ * Helper function for loadTransitionGraph
+ * Parses the decimal integer (after the spaces) in the current line.
+ * Returns the position after the integer or NULL if there's no integer (or it does not fit int).
+ */
+static inline const char* transitionGraphParseInt(const char* p, int* value) {
+    p = transitionGraphSkipSpaces(p);
+    const int negative = (*p == '-');
+    if(*p == '-' || *p == '+') {
+        ++p;
+    }
+    if(*p < '0' || *p > '9') {
+        return NULL;
+    }
+    long long v = 0;
+    while(*p >= '0' && *p <= '9') {
+        v = v * 10 + (*p - '0');
+        if(v > INT_MAX) {
+            return NULL;
+        }
+        ++p;
+    }
+    *value = (int) (negative ? -v : v);
+    return p;
+}
+
+/*
+ * Kinds of the errors found by loadTransitionGraphPart
+ */
+#define TG_LOAD_ERROR_NONE       0
+#define TG_LOAD_ERROR_LINE       1 ///< invalid state or letter of the transition
+#define TG_LOAD_ERROR_TARGET     2 ///< the target is not a number
+#define TG_LOAD_ERROR_STATE      3 ///< the target is out of bounds
+#define TG_LOAD_ERROR_MEMORY     4 ///< the edge buffer cannot be grown
+
+/*
+ * Helper structure for loadTransitionGraph
+ * Part of the transition lines parsed by single thread with its own edge buffer.
+ *
+ * The buffers are allocated with plain malloc/realloc (and must be released with free),
+ * as the GC allocators are not thread-safe.
+ */
+typedef struct TransitionGraphLoadPart {
+    const char* begin; ///< the first line of the part
+    const char* end;   ///< end of the part (just after the line feed or the end of the text)
+    int Q;             ///< number of states
+    int A;             ///< size of the alphabet
+    int* rows;         ///< (q,a) rows of the parsed edges
+    int* targets;      ///< targets of the parsed edges
+    int count;         ///< number of the parsed edges
+    int capacity;      ///< capacity of the edge buffers
+    int lines;         ///< number of the parsed lines
+    int error;         ///< kind of the first error (TG_LOAD_ERROR_*)
+    int errorTarget;   ///< the invalid target (for TG_LOAD_ERROR_STATE)
+    pthread_t thread;  ///< the parsing thread
+} TransitionGraphLoadPart;
+
+/*
+ * Helper function for loadTransitionGraph
+ * Parses the transition lines (q a r [p]) of the part into its edge buffer.
+ * Stops at the first error (the error is kept in the part, the line number is part->lines).
+ */
+static void* loadTransitionGraphPart(void* data) {
+    TransitionGraphLoadPart* part = (TransitionGraphLoadPart*) data;
+    const char* p = part->begin;
+    while(p < part->end && *p != '\0') {
+        ++part->lines;
+        int q;
+        const char* it = transitionGraphParseInt(p, &q);
+        if(it == NULL) {
+            // Not a transition line (e.g. empty one)
+            p = transitionGraphSkipLine(p);
+            continue;
+        }
+        it = transitionGraphSkipSpaces(it);
+        const char a = *it;
+        if(a == '\0' || a == '\n' || q < 0 || q >= part->Q || letterIndex(a) >= part->A) {
+            part->error = TG_LOAD_ERROR_LINE;
+            return NULL;
+        }
+        ++it;
+        
+        const int row = q * part->A + letterIndex(a);
+        while(1) {
+            it = transitionGraphSkipSpaces(it);
+            if(*it == '\n' || *it == '\0') {
+                break;
+            }
+            int r;
+            it = transitionGraphParseInt(it, &r);
+            if(it == NULL) {
+                part->error = TG_LOAD_ERROR_TARGET;
+                return NULL;
+            }
+            if(r < 0 || r >= part->Q) {
+                part->error = TG_LOAD_ERROR_STATE;
+                part->errorTarget = r;
+                return NULL;
+            }
+            if(part->count >= part->capacity) {
+                if(part->capacity > INT_MAX / 2) {
+                    part->error = TG_LOAD_ERROR_MEMORY;
+                    return NULL;
+                }
+                const int capacity = (part->capacity > 0) ? part->capacity * 2 : 1024;
+                int* rows = (int*) realloc(part->rows, sizeof(int) * capacity);
+                if(rows != NULL) {
+                    part->rows = rows;
+                }
+                int* targets = (int*) realloc(part->targets, sizeof(int) * capacity);
+                if(targets != NULL) {
+                    part->targets = targets;
+                }
+                if(rows == NULL || targets == NULL) {
+                    part->error = TG_LOAD_ERROR_MEMORY;
+                    return NULL;
+                }
+                part->capacity = capacity;
+            }
+            part->rows[part->count] = row;
+            part->targets[part->count] = r;
+            ++part->count;
+        }
+        p = transitionGraphSkipLine(it);
+    }
+    return NULL;
+}
+
+/*
+ * Helper function for loadTransitionGraph
+ * Returns the number of threads parsing the transition lines of the given length.
+ */
+static int loadTransitionGraphThreadCount(size_t len) {
+    long thread_count = LOADER_THREADS_COUNT;
+    if(thread_count <= 0) {
+        thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    const size_t max_parts = len / LOADER_THREADS_MIN_BYTES;
+    if(thread_count > (long) max_parts) {
+        thread_count = (long) max_parts;
+    }
+    return (thread_count > 1) ? (int) thread_count : 1;
+}
+
+/**
+ * Reads the transition graph from the given text array.
+ *
+ * Valid graph format is:
+ *
+ *   N A Q U F\n
+ *   q\n
+ *   [q]\n
+ *   [q a r [p]\n]
+ *   
+ *   where
+ *     N is the number of lines of the input;
+ *     A is the size of the alphabet: the alphabet is the set {a,...,x}, where 'x'-'a' = A-1 (A <= 256);
+ *     Q is the number of states: the states are the set {0,...,Q-1};
+ *     U is the number of universal states: universal states = {0, .., U-1}, existential states = {U, .., Q-1};
+ *     F is the number of final states;
+ *     q, r, p denotes some states
+ *     and a is a letter of the alphabet
+ *
+ *  NOTE:
+ *     A sequence [wyr] denotes that the string wyr repeats a finite (greater than or equal to 0) number of times.
+ *
+ *  The graph is sized from the header. Description with states or letters out of the declared bounds
+ *  (or with targets that are not numbers) is considered invalid and causes fatal error.
+ *  The lines can be of any length. Lines not starting with a number are skipped.
+ *
+ *  The text is scanned once with the pointer: no line is copied and nothing is allocated per line.
+ *  Long lists of transitions are split at line feeds into parts of at least LOADER_THREADS_MIN_BYTES bytes
+ *  parsed by up to LOADER_THREADS_COUNT threads. The edges of the parts are merged in the order of the lines,
+ *  so the graph is the same as parsed by single thread.
+ * 
+ * @param[in] input : Input text
+ * @param[in] tg    : Transition graph to be set
+ */
+void loadTransitionGraph(char** input, TransitionGraph tg) {
+    
+    if(input == NULL || *input == NULL) return;
+    
+    const char* p = *input;
+    int line = 1;
+    int N = 0, A = 0, Q = 0, U = 0, F = 0, q0 = 0;
+    
+    // Header lines
+    const char* header = p;
+    int* header_values[5] = { &N, &A, &Q, &U, &F };
+    for(int i=0;i<5 && header!=NULL;++i) {
+        header = transitionGraphParseInt(header, header_values[i]);
+    }
+    p = transitionGraphSkipLine(p);
+    if(transitionGraphParseInt(p, &q0) == NULL) {
+        q0 = -1;
+    }
+    p = transitionGraphSkipLine(p);
+    line = 3;
+    
+    if(header == NULL || A < 0 || A > 256 || Q <= 0 || U < 0 || U > Q || F < 0 || F > Q || q0 < 0 || q0 >= Q || Q > INT_MAX / (A + 1) - 1) {
+        fatal(AUTOMATON, "Invalid automaton header: A=%d Q=%d U=%d F=%d q0=%d", A, Q, U, F, q0);
+    }
+    (void) N;
+    setTransitionGraphHeader(tg, A, Q, U, F, q0);
+    
+    // Accepting states line
+    const char* accepting = p;
+    for(int i=0;i<tg->F;++i) {
+        int q;
+        accepting = transitionGraphParseInt(accepting, &q);
+        if(accepting == NULL || q < 0 || q >= tg->Q) {
+            fatal(AUTOMATON, "Invalid accepting state on position %d", i);
+        }
+        tg->acceptingStates[q] = 1;
+    }
+    p = transitionGraphSkipLine(p);
+    
+    // Transition lines: q a r [p]
+    // The lines are split at line feeds into parts parsed by separate threads
+    const size_t len = strlen(p);
+    const int part_count = loadTransitionGraphThreadCount(len);
+    TransitionGraphLoadPart* parts = MALLOCATE_ARRAY(TransitionGraphLoadPart, part_count);
+    const char* part_begin = p;
+    for(int i=0;i<part_count;++i) {
+        const char* part_end = p + len;
+        if(i < part_count - 1) {
+            part_end = p + len / part_count * (i + 1);
+            if(part_end < part_begin) {
+                part_end = part_begin;
+            }
+            const char* line_end = memchr(part_end, '\n', (size_t) (p + len - part_end));
+            part_end = (line_end != NULL) ? line_end + 1 : p + len;
+        }
+        parts[i].begin = part_begin;
+        parts[i].end = part_end;
+        parts[i].Q = tg->Q;
+        parts[i].A = tg->A;
+        parts[i].rows = NULL;
+        parts[i].targets = NULL;
+        parts[i].count = 0;
+        parts[i].capacity = 0;
+        parts[i].lines = 0;
+        parts[i].error = TG_LOAD_ERROR_NONE;
+        parts[i].errorTarget = 0;
+        part_begin = part_end;
+    }
+    
+    int started = 1;
+    for(int i=1;i<part_count;++i) {
+        if(pthread_create(&parts[i].thread, NULL, loadTransitionGraphPart, &parts[i]) != 0) {
+            log_warn(AUTOMATON, "Failed to create loader thread, continue with %d threads.", started);
+            break;
+        }
+        ++started;
+    }
+    loadTransitionGraphPart(&parts[0]);
+    for(int i=1;i<started;++i) {
+        pthread_join(parts[i].thread, NULL);
+    }
+    for(int i=started;i<part_count;++i) {
+        loadTransitionGraphPart(&parts[i]);
+    }
+    
+    // The first error (in the order of the lines) is reported
+    for(int i=0;i<part_count;++i) {
+        line += parts[i].lines;
+        switch(parts[i].error) {
+            case TG_LOAD_ERROR_LINE:
+                fatal(AUTOMATON, "Invalid transition in line %d", line);
+                break;
+            case TG_LOAD_ERROR_TARGET:
+                fatal(AUTOMATON, "Invalid transition target in line %d", line);
+                break;
+            case TG_LOAD_ERROR_STATE:
+                fatal(AUTOMATON, "Invalid transition target state %d in line %d", parts[i].errorTarget, line);
+                break;
+            case TG_LOAD_ERROR_MEMORY:
+                fatal(AUTOMATON, "Failed to allocate the transitions in line %d", line);
+                break;
+            default:
+                break;
+        }
+    }
+    *input = (char*) (p + len);
+    
+    // Merge the edges of the parts (in the order of the lines, so the graph does not depend on the split)
+    if(part_count == 1) {
+        setTransitionGraphEdges(tg, parts[0].rows, parts[0].targets, parts[0].count);
+    } else {
+        int edge_count = 0;
+        for(int i=0;i<part_count;++i) {
+            if(parts[i].count > INT_MAX - edge_count) {
+                fatal(AUTOMATON, "Too many transitions");
+            }
+            edge_count += parts[i].count;
+        }
+        int* edge_rows = MALLOCATE_ARRAY(int, edge_count > 0 ? edge_count : 1);
+        int* edge_targets = MALLOCATE_ARRAY(int, edge_count > 0 ? edge_count : 1);
+        int offset = 0;
+        for(int i=0;i<part_count;++i) {
+            if(parts[i].count > 0) {
+                memcpy(edge_rows + offset, parts[i].rows, sizeof(int) * parts[i].count);
+                memcpy(edge_targets + offset, parts[i].targets, sizeof(int) * parts[i].count);
+            }
+            offset += parts[i].count;
+        }
+        setTransitionGraphEdges(tg, edge_rows, edge_targets, edge_count);
+        FREE(edge_rows);
+        FREE(edge_targets);
+    }
+    for(int i=0;i<part_count;++i) {
+        free(parts[i].rows);
+        free(parts[i].targets);
+    }
+    FREE(parts);
+    
+    analyseTransitionGraph(tg);
+}
+
+/**
+ * Comparator of ints for qsort (ascending order).
+ */
+static int transitionGraphIntCmp(const void* a, const void* b) {
+    const int x = *((const int*) a);
+    const int y = *((const int*) b);
+    return (x > y) - (x < y);
+}
+
+/**
+ * Helper function for minimizeTransitionGraph.
+ *
+ * Writes the signature of the state into sig: the current block of the state followed by
+ * (letter class, number of blocks, sorted distinct blocks of the successors) for each class with transitions.
+ * Two states of the same block stay in the same block after refinement iff their signatures are equal.
+ *
+ * @param[in]  tg    : Transition graph
+ * @param[in]  block : Current block of each state
+ * @param[in]  q     : State
+ * @param[out] sig   : Output signature (at least 1 + 3 * number of successors of q entries)
+ * @returns Length of the signature
+ */
+static int transitionGraphSignature(TransitionGraph tg, const int* block, int q, int* sig) {
+    int len = 0;
+    sig[len++] = block[q];
+    for(int c=0;c<tg->C;++c) {
+        const int count = transitionCount(tg, q, c);
+        if(count == 0) continue;
+        const int* targets = transitionTargets(tg, q, c);
+        int* list = &sig[len + 2];
+        for(int i=0;i<count;++i) {
+            list[i] = block[targets[i]];
+        }
+        qsort(list, count, sizeof(int), transitionGraphIntCmp);
+        int size = 1;
+        for(int i=1;i<count;++i) {
+            if(list[i] != list[size - 1]) {
+                list[size++] = list[i];
+            }
+        }
+        sig[len] = c;
+        sig[len + 1] = size;
+        len += size + 2;
+    }
+    return len;
+}
+
+/**
+ * Reduces the transition graph in place:
+ * merges bisimilar states and removes states unreachable from the initial one.
+ *
+ * States are bisimilar if they have the same kind (universal or existential), are both final or both not final
+ * and for each letter their successors fall into the same classes of bisimilar states.
+ * Bisimilar states accept the same words (also the ones with letters outside the alphabet),
+ * so all the engines return the same results on the reduced graph.
+ *
+ * The classes are computed by signature refinement (see transitionGraphSignature) until no class is split.
+ * If the refinement exceeds AUTOMATON_MINIMIZATION_WORK_LIMIT then the graph is left unchanged.
+ *
+ * The reduced states are renumbered to a dense range with the universal states first,
+ * successors of each (q,a) are sorted and distinct. The graph is analysed again (see analyseTransitionGraph).
+ *
+ * @param[in] tg : Transition graph
+ * @returns If the graph was reduced?
+ */
+int minimizeTransitionGraph(TransitionGraph tg) {
+    const int Q = tg->Q;
+    const int A = tg->A;
+    const int C = tg->C;
+    const long long round_work = (long long) Q + tg->edgeCount + (long long) Q * C;
+    
+    int* block = MALLOCATE_ARRAY(int, Q);
+    int* next_block = MALLOCATE_ARRAY(int, Q);
+    int* sig_start = MALLOCATE_ARRAY(int, Q + 1);
+    int* sigs = MALLOCATE_ARRAY(int, Q + 3 * tg->edgeCount);
+    
+    // Hash table of the signatures (states being representatives of the blocks)
+    int table_size = 1;
+    while(table_size < 2 * Q) {
+        table_size *= 2;
+    }
+    int* table = MALLOCATE_ARRAY(int, table_size);
+    
+    // Initial partition: kind of the state and if it's final
+    int block_count = 0;
+    int first_block[4] = { -1, -1, -1, -1 };
+    for(int q=0;q<Q;++q) {
+        const int kind = (q < tg->U ? 0 : 2) + (tg->acceptingStates[q] ? 1 : 0);
+        if(first_block[kind] == -1) {
+            first_block[kind] = block_count++;
+        }
+        block[q] = first_block[kind];
+    }
+    
+    long long work = 0;
+    int stable = 0;
+    while(!stable) {
+        work += round_work;
+        if(work > AUTOMATON_MINIMIZATION_WORK_LIMIT) {
+            FREE(block);
+            FREE(next_block);
+            FREE(sig_start);
+            FREE(sigs);
+            FREE(table);
+            return 0;
+        }
+        
+        sig_start[0] = 0;
+        for(int q=0;q<Q;++q) {
+            sig_start[q + 1] = sig_start[q] + transitionGraphSignature(tg, block, q, &sigs[sig_start[q]]);
+        }
+        
+        for(int i=0;i<table_size;++i) {
+            table[i] = -1;
+        }
+        int next_count = 0;
+        for(int q=0;q<Q;++q) {
+            const int* sig = &sigs[sig_start[q]];
+            const int len = sig_start[q + 1] - sig_start[q];
+            uint64_t hash = 14695981039346656037ULL;
+            for(int i=0;i<len;++i) {
+                hash = (hash ^ (uint32_t) sig[i]) * 1099511628211ULL;
+            }
+            int slot = (int)(hash & (uint64_t)(table_size - 1));
+            while(1) {
+                const int r = table[slot];
+                if(r == -1) {
+                    table[slot] = q;
+                    next_block[q] = next_count++;
+                    break;
+                }
+                if(sig_start[r + 1] - sig_start[r] == len && memcmp(&sigs[sig_start[r]], sig, len * sizeof(int)) == 0) {
+                    next_block[q] = next_block[r];
+                    break;
+                }
+                slot = (slot + 1) & (table_size - 1);
+            }
+        }
+        
+        // Blocks are only split, so the same number of blocks means the partition is stable
+        stable = (next_count == block_count);
+        int* swap = block;
+        block = next_block;
+        next_block = swap;
+        block_count = next_count;
+    }
+    FREE(sig_start);
+    FREE(sigs);
+    FREE(table);
+    
+    // Representatives of the blocks and blocks reachable from the initial one
+    int* rep = MALLOCATE_ARRAY(int, block_count);
+    for(int b=0;b<block_count;++b) {
+        rep[b] = -1;
+    }
+    for(int q=0;q<Q;++q) {
+        if(rep[block[q]] == -1) {
+            rep[block[q]] = q;
+        }
+    }
+    char* reached = MALLOCATE_ARRAY(char, block_count);
+    int* queue = MALLOCATE_ARRAY(int, block_count);
+    int queue_end = 0;
+    queue[queue_end++] = block[tg->q0];
+    reached[block[tg->q0]] = 1;
+    for(int i=0;i<queue_end;++i) {
+        const int row_begin = rep[queue[i]] * C;
+        for(int e=tg->rowOffset[row_begin];e<tg->rowOffset[row_begin + C];++e) {
+            const int b = block[tg->edges[e]];
+            if(!reached[b]) {
+                reached[b] = 1;
+                queue[queue_end++] = b;
+            }
+        }
+    }
+    
+    // Dense numbering with the universal states first
+    int* new_id = next_block;
+    int new_Q = 0;
+    int new_U = 0;
+    for(int pass=0;pass<2;++pass) {
+        for(int b=0;b<block_count;++b) {
+            new_id[b] = (pass == 0) ? -1 : new_id[b];
+            if(reached[b] && (rep[b] < tg->U) == (pass == 0)) {
+                new_id[b] = new_Q++;
+            }
+        }
+        if(pass == 0) {
+            new_U = new_Q;
+        }
+    }
+    
+    if(new_Q == Q) {
+        FREE(block);
+        FREE(next_block);
+        FREE(rep);
+        FREE(reached);
+        FREE(queue);
+        return 0;
+    }
+    
+    // Edges are passed to setTransitionGraphEdges per letter (it groups the letters into classes again)
+    int edge_capacity = 1;
+    for(int b=0;b<block_count;++b) {
+        for(int a=0;a<A && new_id[b] != -1;++a) {
+            edge_capacity += transitionCount(tg, rep[b], tg->letterClass[a]);
+        }
+    }
+    char* accepting = MALLOCATE_ARRAY(char, new_Q);
+    int new_F = 0;
+    int edge_count = 0;
+    int* edge_rows = MALLOCATE_ARRAY(int, edge_capacity);
+    int* edge_targets = MALLOCATE_ARRAY(int, edge_capacity);
+    for(int b=0;b<block_count;++b) {
+        if(new_id[b] == -1) continue;
+        const int q = rep[b];
+        const int nq = new_id[b];
+        if(tg->acceptingStates[q]) {
+            accepting[nq] = 1;
+            ++new_F;
+        }
+        for(int a=0;a<A;++a) {
+            const int count = transitionCount(tg, q, tg->letterClass[a]);
+            if(count == 0) continue;
+            const int* targets = transitionTargets(tg, q, tg->letterClass[a]);
+            int* list = &edge_targets[edge_count];
+            for(int i=0;i<count;++i) {
+                list[i] = new_id[block[targets[i]]];
+            }
+            qsort(list, count, sizeof(int), transitionGraphIntCmp);
+            int size = 1;
+            for(int i=1;i<count;++i) {
+                if(list[i] != list[size - 1]) {
+                    list[size++] = list[i];
+                }
+            }
+            for(int i=0;i<size;++i) {
+                edge_rows[edge_count++] = nq * A + a;
+            }
+        }
+    }
+    const int new_q0 = new_id[block[tg->q0]];
+    
+    FREE(block);
+    FREE(next_block);
+    FREE(rep);
+    FREE(reached);
+    FREE(queue);
+    
+    setTransitionGraphHeader(tg, A, new_Q, new_U, new_F, new_q0);
+    memcpy(tg->acceptingStates, accepting, new_Q);
+    setTransitionGraphEdges(tg, edge_rows, edge_targets, edge_count);
+    analyseTransitionGraph(tg);
+    
+    FREE(accepting);
+    FREE(edge_rows);
+    FREE(edge_targets);
+    return 1;
+}
+
+/**
+ * Helper function for saveTransitionGraphDesc.
+ * Appends formatted text to the growing description buffer.
+ *
+ * @param[in] desc     : Pointer to the buffer
+ * @param[in] len      : Pointer to the length of the text in the buffer
+ * @param[in] capacity : Pointer to the size of the buffer
+ * @param[in] format   : printf-like format
+ */
+static void transitionGraphDescAppend(char** desc, int* len, int* capacity, const char* format, ...) {
+    va_list args;
+    while(1) {
+        va_start(args, format);
+        const int written = vsnprintf(*desc + *len, *capacity - *len, format, args);
+        va_end(args);
+        if(written < *capacity - *len) {
+            *len += written;
+            return;
+        }
+        *capacity *= 2;
+        *desc = MREALLOCATE_ARRAY(char, *capacity, *desc);
+    }
+}
+
+/**
+ * Writes the textual representation of the transition graph (see loadTransitionGraph for the format).
+ * Loading the returned description gives graph equal to @p tg.
+ *
+ * Long lists of successors are split into several lines
+ * (loadTransitionGraph merges the lines of the same state and letter).
+ *
+ * NOTE: Returned array must be freed.
+ *
+ * @param[in] tg : Transition graph
+ * @returns Allocated array with textual graph representation
+ */
+char* saveTransitionGraphDesc(const TransitionGraph tg) {
+    const int line_limit = 200;
+    int capacity = 1024;
+    int len = 0;
+    char* desc = MALLOCATE_ARRAY(char, capacity);
+    
+    // Count the transition lines
+    int line_count = 3;
+    for(int q=0;q<tg->Q;++q) {
+        for(int a=0;a<tg->A;++a) {
+            const int count = transitionCount(tg, q, tg->letterClass[a]);
+            const int* targets = transitionTargets(tg, q, tg->letterClass[a]);
+            int line_len = line_limit;
+            for(int i=0;i<count;++i) {
+                if(line_len >= line_limit) {
+                    ++line_count;
+                    line_len = snprintf(NULL, 0, "%d %c", q, (char)(a + 'a'));
+                }
+                line_len += snprintf(NULL, 0, " %d", targets[i]);
+            }
+        }
+    }
+    
+    transitionGraphDescAppend(&desc, &len, &capacity, "%d %d %d %d %d\n%d\n", line_count, tg->A, tg->Q, tg->U, tg->F, tg->q0);
+    int first = 1;
+    for(int q=0;q<tg->Q;++q) {
+        if(tg->acceptingStates[q]) {
+            transitionGraphDescAppend(&desc, &len, &capacity, first ? "%d" : " %d", q);
+            first = 0;
+        }
+    }
+    transitionGraphDescAppend(&desc, &len, &capacity, "\n");
+    
+    for(int q=0;q<tg->Q;++q) {
+        for(int a=0;a<tg->A;++a) {
+            const int count = transitionCount(tg, q, tg->letterClass[a]);
+            const int* targets = transitionTargets(tg, q, tg->letterClass[a]);
+            int line_start = len - line_limit;
+            for(int i=0;i<count;++i) {
+                if(len - line_start >= line_limit) {
+                    if(i > 0) {
+                        transitionGraphDescAppend(&desc, &len, &capacity, "\n");
+                    }
+                    line_start = len;
+                    transitionGraphDescAppend(&desc, &len, &capacity, "%d %c", q, (char)(a + 'a'));
+                }
+                transitionGraphDescAppend(&desc, &len, &capacity, " %d", targets[i]);
+            }
+            if(count > 0) {
+                transitionGraphDescAppend(&desc, &len, &capacity, "\n");
+            }
+        }
+    }
+    
+    return desc;
+}
+
+
+
+/**
+ * Counts the nodes of the run tree of the word, without evaluating it.
+ *
+ * The pass walks the word forward keeping for each state the number of the run tree nodes
+ * in this state at the current depth (each node adds its count to all its successors),
+ * so it visits each reachable (state, depth) pair once. The nodes decided by the analysis
+ * (see acceptPrune) are leaves. The short-circuit of the evaluation is not taken into account,
+ * so the result is an upper bound of the number of nodes visited by acceptSync.
+ *
+ * The pass stops as soon as the count exceeds @p limit (then the result is only known to be above it).
+ *
+ * The pass uses the scratch buffers of the graph (see transitionGraphStatistics), so it must not be run
+ * on the same graph by several threads at once.
+ *
+ * @param[in] tg        : Transition graph
+ * @param[in] word      : Input word
+ * @param[in] word_len  : Input word size
+ * @param[in] limit     : The counting stops when the number of nodes exceeds this value
+ * @param[in] reachable : Pointer to the variable receiving the number of the reachable (state, depth) pairs (can be NULL)
+ * @returns Number of the run tree nodes (or any number greater than @p limit)
+ */
+double estimateRunTree(const TransitionGraph tg, const char* word, int word_len, double limit, long long* reachable) {
+    const int prune = wordInAlphabet(tg, word, word_len);
+    double* counts[2] = { tg->treeCounts, tg->treeCounts + tg->Q };
+    int* frontier[2] = { tg->treeFrontier, tg->treeFrontier + tg->Q };
+    int size[2] = { 1, 0 };
+    int current = 0;
+    double total = 1.0;
+    long long pairs = 1;
+    
+    frontier[current][0] = tg->q0;
+    counts[current][tg->q0] = 1.0;
+    for(int depth=0;depth<word_len && size[current] > 0 && total <= limit;++depth) {
+        const int c = letterClassOf(tg, word[depth]);
+        const int next = !current;
+        size[next] = 0;
+        for(int i=0;i<size[current];++i) {
+            const int q = frontier[current][i];
+            const double count = counts[current][q];
+            counts[current][q] = 0.0;
+            if(prune && acceptPrune(tg, q, word_len - depth) != -1) {
+                continue;
+            }
+            const int branch_count = transitionCount(tg, q, c);
+            const int* branches = transitionTargets(tg, q, c);
+            for(int j=0;j<branch_count;++j) {
+                if(counts[next][branches[j]] == 0.0) {
+                    frontier[next][size[next]++] = branches[j];
+                }
+                counts[next][branches[j]] += count;
+            }
+            total += count * branch_count;
+        }
+        pairs += size[next];
+        current = next;
+    }
+    
+    // The buffers are left zeroed for the next call
+    for(int i=0;i<size[current];++i) {
+        counts[current][frontier[current][i]] = 0.0;
+    }
+    
+    if(reachable != NULL) {
+        *reachable = pairs;
+    }
+    return total;
+}
+
+/**
+ * Structure to hold the costs used by acceptAsync to decide where to fork.
+ *
+ * The costs start from RUN_NODE_COST, RUN_SPAWN_COST and RUN_THREAD_COST. The process measures them while it runs
+ * (the nodes expanded by acceptSync_rec and acceptAsync_rec, the forks done by acceptAsync and the overhead
+ * of the threads of acceptThreads), so that acceptTuningUpdate can replace the estimates with the measured values.
+ * The validator keeps the values learned by the workers and passes them to the next workers.
+ *
+ * The node and thread costs are used by the dispatcher to decide if acceptThreads pays off
+ * (see acceptEngineEstimate in automaton_dispatch.h). The spawn cost is used only by acceptAsync.
+ */
+typedef struct AcceptTuning {
+    double nodeCost;    ///< cost of the run tree node expansion (in nanoseconds)
+    double spawnCost;   ///< cost of the fork of the subprocess (in nanoseconds)
+    int splitRemaining; ///< acceptAsync forks only at the nodes with at least so many letters left (set per word)
+    int forkLimit;      ///< limit of the forks on the path from the root (set per word, see RUN_FORK_LIMIT)
+    long long nodes;    ///< number of the nodes expanded since acceptTuningReset
+    long long spawns;   ///< number of the forks done since acceptTuningReset
+    clock_t spawnTime;  ///< processor time spent on the forks since acceptTuningReset
+    clock_t startTime;  ///< processor time at acceptTuningReset
+    double threadCost;  ///< overhead of single thread of acceptThreads (start, synchronization and splits, in nanoseconds)
+    long long threads;  ///< number of the threads run by acceptThreads since acceptTuningReset
+    long long threadNodes; ///< number of the nodes expanded by acceptThreads since acceptTuningReset
+    clock_t threadTime; ///< processor time of acceptThreads (of all its threads) since acceptTuningReset
+} AcceptTuning;
+
+/**
+ * Costs used by acceptAsync in this process
+ */
+AcceptTuning acceptTuning = { RUN_NODE_COST, RUN_SPAWN_COST, 0, RUN_FORK_LIMIT, 0, 0, 0, 0, RUN_THREAD_COST, 0, 0, 0 };
+
+/**
+ * Starts the measurement of the costs (see AcceptTuning).
+ */
+void acceptTuningReset() {
+    acceptTuning.nodes = 0;
+    acceptTuning.spawns = 0;
+    acceptTuning.spawnTime = 0;
+    acceptTuning.threads = 0;
+    acceptTuning.threadNodes = 0;
+    acceptTuning.threadTime = 0;
+    acceptTuning.startTime = clock();
+}
+
+/**
+ * Replaces the estimated costs with the ones measured since acceptTuningReset.
+ * The node cost is measured only if at least RUN_TUNING_MIN_NODES nodes were expanded
+ * and the spawn cost only if there were any forks. The thread cost is the processor time of acceptThreads
+ * not explained by the expanded nodes (at the node cost), divided by the number of its threads.
+ *
+ * @returns If any of the costs was measured?
+ */
+int acceptTuningUpdate() {
+    const double nanosPerTick = 1e9 / CLOCKS_PER_SEC;
+    int measured = 0;
+    if(acceptTuning.spawns > 0) {
+        acceptTuning.spawnCost = acceptTuning.spawnTime * nanosPerTick / acceptTuning.spawns;
+        measured = 1;
+    }
+    if(acceptTuning.nodes >= RUN_TUNING_MIN_NODES) {
+        const clock_t elapsed = clock() - acceptTuning.startTime - acceptTuning.spawnTime - acceptTuning.threadTime;
+        if(elapsed > 0) {
+            acceptTuning.nodeCost = elapsed * nanosPerTick / acceptTuning.nodes;
+            measured = 1;
+        }
+    }
+    if(acceptTuning.threads > 0) {
+        const double overhead = acceptTuning.threadTime * nanosPerTick - acceptTuning.threadNodes * acceptTuning.nodeCost;
+        if(overhead > 0) {
+            acceptTuning.threadCost = overhead / acceptTuning.threads;
+            measured = 1;
+        }
+    }
+    return measured;
+}
+
+/**
+ * Helper function for acceptSync.
+ * Recursively calculates accept() on the transition graph nodes.
+ * 
+ * @param [in] tg            : Transition graph
+ * @param [in] word          : Input word
+ * @param [in] word_len      : Input word size
+ * @param [in] current_state : Current state of the automaton
+ * @param [in] depth         : Position in word correlated with the current state
+ * @param [in] prune         : If the analysis may be used to skip subtrees (see wordInAlphabet)
+ * @return Is the word accepted by automaton defined by transition graph?
+ */
+int acceptSync_rec(TransitionGraph tg, char* word, int word_len, int current_state, int depth, int prune) {
+    
+    ++(acceptTuning.nodes);
+    
+    if(depth >= word_len) {
+        return tg->acceptingStates[current_state];
+    }
+    
+    if(prune) {
+        const int known = acceptPrune(tg, current_state, word_len - depth);
+        if(known != -1) {
+            return known;
+        }
+    }
+    
+#if DEBUG_ACCEPT_RUN == 1    
+    log_warn(RUN, "At state %d in word {%s} at pos {%d/%d}", current_state, word, depth, word_len);
+#endif
+    
+    const int current_class = letterClassOf(tg, word[depth]);
+    const int branch_count = transitionCount(tg, current_state, current_class);
+    const int* branches = transitionTargets(tg, current_state, current_class);
+    
+    if(current_state >= tg->U) {
+        // Existential state
+        for(int i=0;i<branch_count;++i) {
+            if(acceptSync_rec(tg, word, word_len, branches[i], depth+1, prune)) {
+                return 1;
             }
         }
         return 0;
@@ -282,26 +1962,200 @@ int acceptSync_rec(TransitionGraph tg, char* word, int word_len, int current_sta
    
     // Universal state
     for(int i=0;i<branch_count;++i) {
-        if(!acceptSync_rec(tg, word, word_len, tg->graph[current_state][current_letter][i], depth+1)) {
+        if(!acceptSync_rec(tg, word, word_len, branches[i], depth+1, prune)) {
             return 0;
         }
     }
-    return 1;
+    return 1;
+}
+
+/**
+ * Helper function for acceptMemo.
+ * Works exactly as acceptSync_rec, but the result of each (state, depth) pair is cached
+ * inside the memo table, so every such pair is expanded at most once.
+ *
+ * The memo table has word_len*Q entries:
+ *   memo[depth*Q + state] is 0 when the pair was not yet visited,
+ *   1 when it's rejecting and 2 when it's accepting.
+ *
+ * @param [in] tg            : Transition graph
+ * @param [in] word          : Input word
+ * @param [in] word_len      : Input word size
+ * @param [in] current_state : Current state of the automaton
+ * @param [in] depth         : Position in word correlated with the current state
+ * @param [in] prune         : If the analysis may be used to skip subtrees (see wordInAlphabet)
+ * @param [in] memo          : Memo table
+ * @return Is the word accepted by automaton defined by transition graph?
+ */
+static int acceptMemo_rec(TransitionGraph tg, char* word, int word_len, int current_state, int depth, int prune, char* memo) {
+
+    if(depth >= word_len) {
+        return tg->acceptingStates[current_state];
+    }
+
+    if(prune) {
+        const int known = acceptPrune(tg, current_state, word_len - depth);
+        if(known != -1) {
+            return known;
+        }
+    }
+
+    char* memo_entry = &memo[(size_t) depth * tg->Q + current_state];
+    if(*memo_entry) {
+        return *memo_entry - 1;
+    }
+
+#if DEBUG_ACCEPT_RUN == 1
+    log_warn(RUN, "At state %d in word {%s} at pos {%d/%d}", current_state, word, depth, word_len);
+#endif
+
+    const int current_class = letterClassOf(tg, word[depth]);
+    const int branch_count = transitionCount(tg, current_state, current_class);
+    const int* branches = transitionTargets(tg, current_state, current_class);
+
+    // Existential state looks for the first accepting branch
+    // Universal state looks for the first rejecting one
+    const int is_existential_state = (current_state >= tg->U);
+    int result = !is_existential_state;
+
+    for(int i=0;i<branch_count;++i) {
+        if(acceptMemo_rec(tg, word, word_len, branches[i], depth+1, prune, memo) == is_existential_state) {
+            result = is_existential_state;
+            break;
+        }
+    }
+
+    *memo_entry = (char)(result + 1);
+    return result;
+}
+
+/**
+ * Single step of the backward evaluation used by acceptBitset.
+ *
+ * Given the set @p next of states accepting the suffix w[i+1..] calculates
+ * the set @p out of states accepting the suffix w[i..] where w[i] is a letter of class @p c:
+ *
+ *   * universal state q belongs to @p out iff T(q, w[i]) is contained in @p next
+ *   * existential state q belongs to @p out iff T(q, w[i]) overlaps @p next
+ *
+ * The variant specialized for the number of states is used (see selectTransitionGraphVariant).
+ *
+ * @param [in]  tg     : Transition graph
+ * @param [in]  next   : Set of states accepting the rest of the word
+ * @param [in]  c      : Letter class (see letterClassOf)
+ * @param [out] out    : Output set
+ */
+static inline void stateSetStepBack(TransitionGraph tg, const uint64_t* next, int c, StateSet out) {
+    tg->stepBack(tg, next, c, out);
+}
+
+/**
+ * Backward step (see stateSetStepBack) for any number of states.
+ *
+ * If the step tables were built the whole step is done by the step kernel (see automaton_simd.h).
+ * Otherwise for dense rows the successors set is tested at once, for sparse ones the successors list is scanned.
+ *
+ * @param [in]  tg     : Transition graph
+ * @param [in]  next   : Set of states accepting the rest of the word
+ * @param [in]  c      : Letter class (see letterClassOf)
+ * @param [out] out    : Output set
+ */
+void stateSetStepBackDynamic(TransitionGraph tg, const uint64_t* next, int c, StateSet out) {
+    const int words = tg->setWords;
+    stateSetClear(out, words);
+    
+    if(c < 0 || c >= tg->C) {
+        // Letter without transitions so only universal states accept
+        for(int q=0;q<tg->U;++q) {
+            stateSetAdd(out, q);
+        }
+        return;
+    }
+    
+    if(tg->stepTables != NULL) {
+        // Predecessors of the states in next (in) and outside next (not_in)
+        const int stride = tg->stepStride;
+        uint64_t in[stride];
+        uint64_t not_in[stride];
+        uint64_t next_padded[stride];
+        stateSetCopy(next_padded, next, words);
+        for(int w=words;w<stride;++w) {
+            next_padded[w] = 0;
+        }
+        tg->stepKernel->kernel(&(tg->stepTables[(size_t) c * tg->stepChunks * 256 * stride]), tg->stepChunks, stride, next_padded, in, not_in);
+        const uint64_t* existential = tg->stepMasks;
+        const uint64_t* universal = &(tg->stepMasks[stride]);
+        for(int w=0;w<words;++w) {
+            out[w] = (in[w] & existential[w]) | (universal[w] & ~not_in[w]);
+        }
+        return;
+    }
+    
+    // Universal states
+    for(int q=0;q<tg->U;++q) {
+        const int row = q * tg->C + c;
+        int accepting = 1;
+        if(tg->denseRow[row] != -1) {
+            const uint64_t* succ = &(tg->denseMasks[tg->denseRow[row] * words]);
+            for(int w=0;w<words;++w) {
+                if(succ[w] & ~next[w]) {
+                    accepting = 0;
+                    break;
+                }
+            }
+        } else {
+            for(int i=tg->rowOffset[row];i<tg->rowOffset[row + 1];++i) {
+                if(!stateSetHas(next, tg->edges[i])) {
+                    accepting = 0;
+                    break;
+                }
+            }
+        }
+        if(accepting) {
+            stateSetAdd(out, q);
+        }
+    }
+    
+    // Existential states
+    for(int q=tg->U;q<tg->Q;++q) {
+        const int row = q * tg->C + c;
+        int accepting = 0;
+        if(tg->denseRow[row] != -1) {
+            const uint64_t* succ = &(tg->denseMasks[tg->denseRow[row] * words]);
+            for(int w=0;w<words;++w) {
+                if(succ[w] & next[w]) {
+                    accepting = 1;
+                    break;
+                }
+            }
+        } else {
+            for(int i=tg->rowOffset[row];i<tg->rowOffset[row + 1];++i) {
+                if(stateSetHas(next, tg->edges[i])) {
+                    accepting = 1;
+                    break;
+                }
+            }
+        }
+        if(accepting) {
+            stateSetAdd(out, q);
+        }
+    }
 }
 
 /*
  * Declaration of async accept helper
  */
-static int acceptAsync_rec(TransitionGraph tg, char* word, int word_len, int current_state, int depth, int* workload, int parent_fork_count);
+static int acceptAsync_rec(TransitionGraph tg, char* word, int word_len, int current_state, int depth, int prune, int parent_fork_count);
 
 /*
  * Helper function for acceptAsync_rec
  * Executes async accept on subprocesses and collects results
  */
-static int acceptAsync_node(int is_existential_state, TransitionGraph tg, char* word, int word_len, int current_state, int depth, int* workload, int parent_fork_count) {
+static int acceptAsync_node(int is_existential_state, TransitionGraph tg, char* word, int word_len, int current_state, int depth, int prune, int parent_fork_count) {
     
-    const int current_letter = (int)(word[depth]-'a');
-    const int branch_count = tg->size[current_state][current_letter];
+    const int current_class = letterClassOf(tg, word[depth]);
+    const int branch_count = transitionCount(tg, current_state, current_class);
+    const int* branches = transitionTargets(tg, current_state, current_class);
     
     MsgPipeID acceptAsyncDataPipeID[branch_count];
     MsgPipe acceptAsyncDataPipe[branch_count];
@@ -318,8 +2172,13 @@ static int acceptAsync_node(int is_existential_state, TransitionGraph tg, char*
     
     for(int i=1;i<branch_count;++i) {
         
+        const clock_t spawnStart = clock();
         acceptAsyncDataPipeID[i] = msgPipeCreate(5);
         int status = processFork(&acceptAsyncPid[i]);
+        if(status != 1) {
+            acceptTuning.spawnTime += clock() - spawnStart;
+            ++(acceptTuning.spawns);
+        }
         
         if(status == -1) {
             opened_state[i] = 0;
@@ -328,8 +2187,7 @@ static int acceptAsync_node(int is_existential_state, TransitionGraph tg, char*
             log_warn(RUN, "Failed to fork subprocess fallback into sync operating mode.");
             
             // Manually calculate the path for which fork() has failed
-            int localWorkload = 0;
-            int localValue = acceptAsync_rec(tg, word, word_len, tg->graph[current_state][current_letter][i], depth+1, &localWorkload, parent_fork_count+branch_count-1);
+            int localValue = acceptAsync_rec(tg, word, word_len, branches[i], depth+1, prune, parent_fork_count+branch_count-1);
             if((is_existential_state && localValue) || (!is_existential_state && !localValue)) {
                 // Synchronize
                 if(processWaitForAll() == -1) {
@@ -346,9 +2204,7 @@ static int acceptAsync_node(int is_existential_state, TransitionGraph tg, char*
         } else if(status == 1) {
             MsgPipe parentPipe = msgPipeOpen(acceptAsyncDataPipeID[i]);
             
-            int new_workload = 0;
-            
-            if(acceptAsync_rec(tg, word, word_len, tg->graph[current_state][current_letter][i], depth+1, &new_workload, parent_fork_count+branch_count-1)) {
+            if(acceptAsync_rec(tg, word, word_len, branches[i], depth+1, prune, parent_fork_count+branch_count-1)) {
                 msgPipeWrite(parentPipe, "A");
                 msgPipeClose(&parentPipe);
             } else {
@@ -364,7 +2220,7 @@ static int acceptAsync_node(int is_existential_state, TransitionGraph tg, char*
     }
     
     // Calculate in the original thread
-    int originValue = acceptAsync_rec(tg, word, word_len, tg->graph[current_state][current_letter][0], depth+1, workload, parent_fork_count+branch_count-1);
+    int originValue = acceptAsync_rec(tg, word, word_len, branches[0], depth+1, prune, parent_fork_count+branch_count-1);
     
     // Synchronize
     if(processWaitForAll() == -1) {
@@ -402,43 +2258,55 @@ static int acceptAsync_node(int is_existential_state, TransitionGraph tg, char*
  *
  * Recursively calculates accept() on the transition graph nodes.
  * This function uses multiprocess asynchronious approach or synchronized version depending on
- * heuristic value workload.
+ * the expected work of the subtree (see AcceptTuning).
  *
- * The workload is the number of nodes parsed by the algorithm so far.
- * That is zeroed after fork.
- *
- * If the workload exceeds RUN_WORKLOAD_LIMIT then forking is preffered over synchronious code.
+ * The subtrees with less than acceptTuning.splitRemaining letters left are too small
+ * to pay off the fork, so they are evaluated synchronously. Above that the node forks
+ * unless acceptTuning.forkLimit forks were already done on the path from the root.
  * 
- * @param [in] tg            : Transition graph
- * @param [in] word          : Input word
- * @param [in] word_len      : Input word size
- * @param [in] current_state : Current state of the automaton
- * @param [in] depth         : Position in word correlated with the current state
- * @param [in] workload      : Pointer to workload value 
+ * @param [in] tg                : Transition graph
+ * @param [in] word              : Input word
+ * @param [in] word_len          : Input word size
+ * @param [in] current_state     : Current state of the automaton
+ * @param [in] depth             : Position in word correlated with the current state
+ * @param [in] prune             : If the analysis may be used to skip subtrees (see wordInAlphabet)
+ * @param [in] parent_fork_count : Number of forks done on the path from the root
  *
  * @return Is the word accepted by automaton defined by transition graph?
  */
-static int acceptAsync_rec(TransitionGraph tg, char* word, int word_len, int current_state, int depth, int* workload, int parent_fork_count) {
+static int acceptAsync_rec(TransitionGraph tg, char* word, int word_len, int current_state, int depth, int prune, int parent_fork_count) {
     
-    ++(*workload);
+    if(word_len - depth < acceptTuning.splitRemaining) {
+        return acceptSync_rec(tg, word, word_len, current_state, depth, prune);
+    }
+    
+    ++(acceptTuning.nodes);
     
     if(depth >= word_len) {
         return tg->acceptingStates[current_state];
     }
     
+    if(prune) {
+        const int known = acceptPrune(tg, current_state, word_len - depth);
+        if(known != -1) {
+            return known;
+        }
+    }
+    
 #if DEBUG_ACCEPT_RUN == 1    
     log_warn(RUN, "At state %d in word {%s} at pos {%d/%d}", current_state, word, depth, word_len);
 #endif
     
-    if(*workload < RUN_WORKLOAD_LIMIT || parent_fork_count > RUN_FORK_LIMIT) {
+    if(parent_fork_count > acceptTuning.forkLimit) {
         // Sync version
         
-        const int current_letter = (int)(word[depth] - 'a');
-        const int branch_count = tg->size[current_state][current_letter];
+        const int current_class = letterClassOf(tg, word[depth]);
+        const int branch_count = transitionCount(tg, current_state, current_class);
+        const int* branches = transitionTargets(tg, current_state, current_class);
         if(current_state >= tg->U) {
             // Existential state
             for(int i=0;i<branch_count;++i) {
-                if(acceptSync_rec(tg, word, word_len, tg->graph[current_state][current_letter][i], depth+1)) {
+                if(acceptSync_rec(tg, word, word_len, branches[i], depth+1, prune)) {
                     return 1;
                 }
             }
@@ -447,7 +2315,7 @@ static int acceptAsync_rec(TransitionGraph tg, char* word, int word_len, int cur
         
         // Universal state
         for(int i=0;i<branch_count;++i) {
-            if(!acceptSync_rec(tg, word, word_len, tg->graph[current_state][current_letter][i], depth+1)) {
+            if(!acceptSync_rec(tg, word, word_len, branches[i], depth+1, prune)) {
                 return 0;
             }
         }
@@ -457,11 +2325,11 @@ static int acceptAsync_rec(TransitionGraph tg, char* word, int word_len, int cur
         
         if(current_state >= tg->U) {
             // Existential state
-            return acceptAsync_node(1, tg, word, word_len, current_state, depth, workload, parent_fork_count);
+            return acceptAsync_node(1, tg, word, word_len, current_state, depth, prune, parent_fork_count);
         }
         
         // Universal state
-        return acceptAsync_node(0, tg, word, word_len, current_state, depth, workload, parent_fork_count);
+        return acceptAsync_node(0, tg, word, word_len, current_state, depth, prune, parent_fork_count);
     }
 }
 
@@ -474,20 +2342,707 @@ static int acceptAsync_rec(TransitionGraph tg, char* word, int word_len, int cur
  * @return Is the word accepted by automaton defined by transition graph?
  */
 int acceptSync(TransitionGraph tg, char* word) {
-    return acceptSync_rec(tg, word, strlen(word), tg->q0, 0);
+    const int word_len = strlen(word);
+    return acceptSync_rec(tg, word, word_len, tg->q0, 0, wordInAlphabet(tg, word, word_len));
+}
+
+/*
+ * Number of the words evaluated together by acceptLockstep
+ */
+#define ACCEPT_LOCKSTEP_LANES (64 * ACCEPT_LOCKSTEP_WORDS)
+
+/*
+ * Lane mask of acceptLockstep (bit j of the mask refers to the j-th word of the group)
+ */
+typedef struct AcceptLockstepMask {
+    uint64_t w[ACCEPT_LOCKSTEP_WORDS];
+} AcceptLockstepMask;
+
+/*
+ * Helper function for acceptLockstep
+ * Orders the words by length.
+ */
+static int acceptLockstepCmp(const void* a, const void* b) {
+    const int* x = (const int*) a;
+    const int* y = (const int*) b;
+    if(x[0] != y[0]) {
+        return (x[0] < y[0]) ? -1 : 1;
+    }
+    return x[1] - y[1];
+}
+
+/*
+ * Helper function for acceptLockstep
+ * Evaluates the group of up to ACCEPT_LOCKSTEP_LANES words.
+ *
+ * cur[q] is the set of the words (lanes) whose suffix read so far is accepted from q.
+ * The words are aligned at their ends, so at step t the lane j reads the letter w_j[len_j-1-t].
+ * The lanes whose word is already read keep their sets unchanged.
+ */
+static void acceptLockstepGroup(TransitionGraph tg, char** words, const int* order, int count, int* results,
+                                AcceptLockstepMask* cur, AcceptLockstepMask* next, AcceptLockstepMask* class_lanes, int* present, int* class_step) {
+    const int W = ACCEPT_LOCKSTEP_WORDS;
+    int max_len = 0;
+    for(int j=0;j<count;++j) {
+        if(order[2*j] > max_len) {
+            max_len = order[2*j];
+        }
+    }
+    
+    AcceptLockstepMask all;
+    for(int w=0;w<W;++w) {
+        all.w[w] = 0;
+    }
+    for(int j=0;j<count;++j) {
+        all.w[j / 64] |= ((uint64_t) 1) << (j % 64);
+    }
+    for(int q=0;q<tg->Q;++q) {
+        for(int w=0;w<W;++w) {
+            cur[q].w[w] = tg->acceptingStates[q] ? all.w[w] : 0;
+        }
+    }
+    for(int c=0;c<=tg->C;++c) {
+        for(int w=0;w<W;++w) {
+            class_lanes[c].w[w] = 0;
+        }
+        class_step[c] = -1;
+    }
+    
+    for(int t=0;t<max_len;++t) {
+        // Lanes of each letter class at this step (class -1 is stored at index C)
+        int present_count = 0;
+        AcceptLockstepMask active;
+        for(int w=0;w<W;++w) {
+            active.w[w] = 0;
+        }
+        for(int j=0;j<count;++j) {
+            const int len = order[2*j];
+            if(t >= len) {
+                continue;
+            }
+            int c = letterClassOf(tg, words[order[2*j+1]][len-1-t]);
+            if(c < 0) {
+                c = tg->C;
+            }
+            if(class_step[c] != t) {
+                class_step[c] = t;
+                present[present_count++] = c;
+            }
+            class_lanes[c].w[j / 64] |= ((uint64_t) 1) << (j % 64);
+            active.w[j / 64] |= ((uint64_t) 1) << (j % 64);
+        }
+        
+        for(int q=0;q<tg->Q;++q) {
+            const int is_universal = (q < tg->U);
+            AcceptLockstepMask acc;
+            for(int w=0;w<W;++w) {
+                acc.w[w] = cur[q].w[w] & ~active.w[w];
+            }
+            for(int k=0;k<present_count;++k) {
+                const int c = present[k];
+                const AcceptLockstepMask* lanes = &class_lanes[c];
+                if(c == tg->C) {
+                    // Letter without transitions so only universal states accept
+                    if(is_universal) {
+                        for(int w=0;w<W;++w) {
+                            acc.w[w] |= lanes->w[w];
+                        }
+                    }
+                    continue;
+                }
+                
+                // Universal state needs all the successors, existential any of them
+                AcceptLockstepMask val;
+                for(int w=0;w<W;++w) {
+                    val.w[w] = is_universal ? ~((uint64_t) 0) : 0;
+                }
+                const int branch_count = transitionCount(tg, q, c);
+                const int* branches = transitionTargets(tg, q, c);
+                for(int i=0;i<branch_count;++i) {
+                    const AcceptLockstepMask* succ = &cur[branches[i]];
+                    if(is_universal) {
+                        for(int w=0;w<W;++w) {
+                            val.w[w] &= succ->w[w];
+                        }
+                    } else {
+                        for(int w=0;w<W;++w) {
+                            val.w[w] |= succ->w[w];
+                        }
+                    }
+                }
+                for(int w=0;w<W;++w) {
+                    acc.w[w] |= val.w[w] & lanes->w[w];
+                }
+            }
+            next[q] = acc;
+        }
+        
+        for(int k=0;k<present_count;++k) {
+            for(int w=0;w<W;++w) {
+                class_lanes[present[k]].w[w] = 0;
+            }
+        }
+        
+        AcceptLockstepMask* swap = cur;
+        cur = next;
+        next = swap;
+    }
+    
+    for(int j=0;j<count;++j) {
+        results[order[2*j+1]] = (cur[tg->q0].w[j / 64] >> (j % 64)) & 1;
+    }
+}
+
+/**
+ * Calculates accept() for many words at once.
+ *
+ * The words are evaluated backwards (like acceptBitset) in lockstep, in groups of ACCEPT_LOCKSTEP_LANES words
+ * of similar length. For each state the set of the words accepted from it is kept as a bit mask
+ * (one lane per word), so each transition is loaded once per step for the whole group
+ * and evaluated with a few bitwise operations on the masks.
+ * Gives the same answers as acceptSync called for each of the words.
+ *
+ * @param [in]  tg      : Transition graph
+ * @param [in]  words   : Input words
+ * @param [in]  count   : Number of the input words
+ * @param [out] results : results[i] is set to 1 if words[i] is accepted; 0 otherwise
+ */
+void acceptLockstep(TransitionGraph tg, char** words, int count, int* results) {
+    if(count <= 0) {
+        return;
+    }
+    
+    // Pairs (length, index) sorted by length, so the groups waste few lanes
+    int* order = MALLOCATE_ARRAY(int, 2 * count);
+    for(int i=0;i<count;++i) {
+        order[2*i] = strlen(words[i]);
+        order[2*i+1] = i;
+    }
+    qsort(order, count, 2 * sizeof(int), acceptLockstepCmp);
+    
+    AcceptLockstepMask* cur = MALLOCATE_ARRAY(AcceptLockstepMask, tg->Q);
+    AcceptLockstepMask* next = MALLOCATE_ARRAY(AcceptLockstepMask, tg->Q);
+    AcceptLockstepMask* class_lanes = MALLOCATE_ARRAY(AcceptLockstepMask, tg->C + 1);
+    int* present = MALLOCATE_ARRAY(int, tg->C + 1);
+    int* class_step = MALLOCATE_ARRAY(int, tg->C + 1);
+    
+    for(int first=0;first<count;first+=ACCEPT_LOCKSTEP_LANES) {
+        const int group = (count - first < ACCEPT_LOCKSTEP_LANES) ? (count - first) : ACCEPT_LOCKSTEP_LANES;
+        acceptLockstepGroup(tg, words, &order[2*first], group, results, cur, next, class_lanes, present, class_step);
+    }
+    
+    FREE(order);
+    FREE(cur);
+    FREE(next);
+    FREE(class_lanes);
+    FREE(present);
+    FREE(class_step);
 }
 
 /**
  * Recursively calculates accept() on the transition graph nodes.
- * This function uses multiprocess asynchronious approach or synchronized version depending on heuristic values.
+ * This function uses multiprocess asynchronious approach or synchronized version depending on
+ * the costs in acceptTuning.
+ *
+ * The subtree with r letters left is expected to have 1 + b + ... + b^r nodes, where b is
+ * the average branching of the automaton (computed once, see transitionGraphStatistics).
+ * The split threshold is the smallest r for which the expected subtree work exceeds the fork cost, so the forks are done only when they pay off.
  *
  * @param [in] tg            : Transition graph
  * @param [in] word          : Input word
  * @return Is the word accepted by automaton defined by transition graph?
  */
 int acceptAsync(TransitionGraph tg, char* word) {
-    int workload = 1;
-    return acceptAsync_rec(tg, word, strlen(word), tg->q0, 0, &workload, 0);
+    const int word_len = strlen(word);
+    
+    const double branching = tg->branching;
+    
+    // Split threshold
+    const double spawnNodes = acceptTuning.spawnCost / (acceptTuning.nodeCost > 0 ? acceptTuning.nodeCost : 1);
+    double level = 1.0;
+    double subtree = 1.0;
+    acceptTuning.splitRemaining = 0;
+    while(subtree <= spawnNodes && acceptTuning.splitRemaining <= word_len) {
+        level *= branching;
+        subtree += level;
+        ++(acceptTuning.splitRemaining);
+        if(branching <= 1.0 && acceptTuning.splitRemaining > spawnNodes) {
+            break;
+        }
+    }
+    
+    // Limit of the forks on the path: about twice as many processes as processors
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    acceptTuning.forkLimit = 1;
+    while(processors > 1 && acceptTuning.forkLimit < RUN_FORK_LIMIT) {
+        processors /= 2;
+        ++(acceptTuning.forkLimit);
+    }
+    
+    log(RUN, "Async split at %d letters left (node cost %.1fns, fork cost %.1fns, fork limit %d)", acceptTuning.splitRemaining, acceptTuning.nodeCost, acceptTuning.spawnCost, acceptTuning.forkLimit);
+    
+    return acceptAsync_rec(tg, word, word_len, tg->q0, 0, wordInAlphabet(tg, word, word_len), 0);
+}
+
+/*
+ * Frame of the explicit stack used by acceptIterative
+ */
+typedef struct AcceptIterativeFrame AcceptIterativeFrame;
+
+/*
+ * Strucutre containing single frame of acceptIterative.
+ * The frame on position d of the stack is the run tree node at depth d (position d in the word).
+ */
+struct AcceptIterativeFrame {
+    const int* next; ///< next successor to be evaluated
+    const int* end;  ///< end of the successors array
+    int state;       ///< state of the automaton
+};
+
+/**
+ * Calculates accept() on the transition graph nodes with no recursion.
+ *
+ * Works exactly as acceptSync, but the path from the root of the run tree to the current node
+ * is kept in preallocated stack of |w| frames, so the memory use is known in advance
+ * and there's no limit of the word length other than the available memory.
+ *
+ * The evaluation alternates two phases:
+ *   * descend - the node on the top of the stack is expanded and its first successor is pushed
+ *               (the nodes at the last position of the word check their successors in place)
+ *   * ascend  - the result is passed to the parents until one of them has undecided result
+ *               and some successors left (existential stop at the first accepting branch,
+ *               universal at the first rejecting one)
+ *
+ * @param [in] tg            : Transition graph
+ * @param [in] word          : Input word
+ * @return Is the word accepted by automaton defined by transition graph?
+ */
+int acceptIterative(TransitionGraph tg, char* word) {
+    const int word_len = strlen(word);
+    if(word_len == 0) {
+        return tg->acceptingStates[tg->q0];
+    }
+    
+    const int prune = wordInAlphabet(tg, word, word_len);
+    AcceptIterativeFrame* stack = MALLOCATE_ARRAY(AcceptIterativeFrame, word_len);
+    int top = 0;
+    int result;
+    stack[0].state = tg->q0;
+    
+    while(top >= 0) {
+        // Descend
+        AcceptIterativeFrame* frame = &stack[top];
+        const int is_existential_state = (frame->state >= tg->U);
+        const int known = prune ? acceptPrune(tg, frame->state, word_len - top) : -1;
+        
+        if(known != -1) {
+            result = known;
+        } else {
+#if DEBUG_ACCEPT_RUN == 1
+            log_warn(RUN, "At state %d in word {%s} at pos {%d/%d}", frame->state, word, top, word_len);
+#endif
+            const int current_class = letterClassOf(tg, word[top]);
+            const int* branches = transitionTargets(tg, frame->state, current_class);
+            const int* branches_end = branches + transitionCount(tg, frame->state, current_class);
+            
+            result = !is_existential_state;
+            if(top + 1 == word_len) {
+                for(;branches<branches_end;++branches) {
+                    if(tg->acceptingStates[*branches] == is_existential_state) {
+                        result = is_existential_state;
+                        break;
+                    }
+                }
+            } else if(branches < branches_end) {
+                frame->next = branches + 1;
+                frame->end = branches_end;
+                stack[++top].state = *branches;
+                continue;
+            }
+        }
+        
+        // Ascend
+        while(--top >= 0) {
+            frame = &stack[top];
+            const int is_existential_parent = (frame->state >= tg->U);
+            if(result == is_existential_parent) {
+                continue;
+            }
+            if(frame->next < frame->end) {
+                stack[++top].state = *(frame->next++);
+                break;
+            }
+            result = !is_existential_parent;
+        }
+    }
+    
+    FREE(stack);
+    return result;
+}
+
+int acceptBitset(TransitionGraph tg, char* word);
+
+/**
+ * Recursively calculates accept() on the transition graph nodes.
+ * This function uses synchronized single-process approach and memoizes the result
+ * of each (state, depth) pair, so the run takes at most O(|w| * (Q + E)) steps (E is the number of edges).
+ * The memo table takes |w| * Q bytes. If that exceeds ACCEPT_MEMO_MEMORY_LIMIT the word is evaluated
+ * by acceptBitset instead.
+ *
+ * Gives the same answers as acceptSync.
+ *
+ * @param [in] tg            : Transition graph
+ * @param [in] word          : Input word
+ * @return Is the word accepted by automaton defined by transition graph?
+ */
+int acceptMemo(TransitionGraph tg, char* word) {
+    const int word_len = strlen(word);
+    if(word_len == 0) {
+        return tg->acceptingStates[tg->q0];
+    }
+
+    const size_t memo_size = (size_t) word_len * tg->Q;
+    if(memo_size > ACCEPT_MEMO_MEMORY_LIMIT) {
+        log_warn(AUTOMATON, "Memo table of %zu bytes exceeds the limit - use bitset accept.", memo_size);
+        return acceptBitset(tg, word);
+    }
+
+    char* memo = (char*) calloc(memo_size, 1);
+    if(memo == NULL) {
+        syserr("Failed to allocate memo table of %zu bytes", memo_size);
+    }
+    GC_ON_ALLOC(memo);
+    const int result = acceptMemo_rec(tg, word, word_len, tg->q0, 0, wordInAlphabet(tg, word, word_len), memo);
+    FREE(memo);
+
+    return result;
+}
+
+/**
+ * Calculates accept() evaluating the word from right to left on sets of states.
+ *
+ * Starting from the set of the accepting states, at each position (from the last one)
+ * the set of states accepting the remaining suffix is calculated (see stateSetStepBack).
+ * The word is accepted iff the initial state belongs to the final set.
+ *
+ * This function uses no recursion and no subprocesses and runs in O(|w| * Q) steps.
+ * Gives the same answers as acceptSync.
+ * The variant specialized for the number of states is used (see selectTransitionGraphVariant).
+ *
+ * @param [in] tg            : Transition graph
+ * @param [in] word          : Input word
+ * @return Is the word accepted by automaton defined by transition graph?
+ */
+int acceptBitset(TransitionGraph tg, char* word) {
+    return tg->bitsetAccept(tg, word);
+}
+
+/**
+ * Bitset accept (see acceptBitset) for any number of states.
+ *
+ * @param [in] tg            : Transition graph
+ * @param [in] word          : Input word
+ * @return Is the word accepted by automaton defined by transition graph?
+ */
+int acceptBitsetDynamic(TransitionGraph tg, char* word) {
+    const int words = tg->setWords;
+    uint64_t sets[2][words];
+    int current = 0;
+    
+    stateSetCopy(sets[current], tg->acceptingMask, words);
+    for(int i=strlen(word)-1;i>=0;--i) {
+        stateSetStepBackDynamic(tg, sets[current], letterClassOf(tg, word[i]), sets[!current]);
+        current = !current;
+    }
+    
+    return stateSetHas(sets[current], tg->q0);
+}
+
+/*
+ * Node of the reversed trie used by acceptBatch
+ */
+typedef struct AcceptBatchNode AcceptBatchNode;
+
+/*
+ * Strucutre containing node of the reversed trie used by acceptBatch.
+ * Path from the root to the node spells reversed suffix of some of the words.
+ * Set of states accepting that suffix is stored separately (setWords words per node).
+ */
+struct AcceptBatchNode {
+    int letter;      ///< class of the letter on the edge from the parent (see letterClassOf)
+    int firstChild;  ///< first child node (-1 if there's none)
+    int nextSibling; ///< next node with the same parent (-1 if there's none)
+};
+
+/**
+ * Calculates accept() for the batch of words.
+ *
+ * The words are inserted reversed into a trie, so the words sharing common suffix
+ * share the path from the root. Each trie node is evaluated once (by a single step of the backward
+ * evaluation - see acceptBitset) and its result is used by all the words below it.
+ * Gives the same answers as acceptSync called for each of the words.
+ *
+ * It comes close to acceptLockstep only for words sharing long suffixes, so acceptLockstep should be used for batches.
+ *
+ * @param [in]  tg      : Transition graph
+ * @param [in]  words   : Input words
+ * @param [in]  count   : Number of the input words
+ * @param [out] results : results[i] is set to 1 if words[i] is accepted; 0 otherwise
+ */
+void acceptBatch(TransitionGraph tg, char** words, int count, int* results) {
+    int node_limit = 1;
+    for(int i=0;i<count;++i) {
+        node_limit += strlen(words[i]);
+    }
+    
+    const int set_words = tg->setWords;
+    AcceptBatchNode* nodes = MALLOCATE_ARRAY(AcceptBatchNode, node_limit);
+    uint64_t* sets = MALLOCATE_ARRAY(uint64_t, node_limit * set_words);
+    int node_count = 1;
+    
+    stateSetCopy(sets, tg->acceptingMask, set_words);
+    nodes[0].letter = -1;
+    nodes[0].firstChild = -1;
+    nodes[0].nextSibling = -1;
+    
+    for(int i=0;i<count;++i) {
+        int node = 0;
+        for(int j=strlen(words[i])-1;j>=0;--j) {
+            const int letter = letterClassOf(tg, words[i][j]);
+            
+            int child = nodes[node].firstChild;
+            while(child != -1 && nodes[child].letter != letter) {
+                child = nodes[child].nextSibling;
+            }
+            
+            if(child == -1) {
+                // This suffix was not seen yet so evaluate it
+                child = node_count++;
+                stateSetStepBack(tg, &sets[node * set_words], letter, &sets[child * set_words]);
+                nodes[child].letter = letter;
+                nodes[child].firstChild = -1;
+                nodes[child].nextSibling = nodes[node].firstChild;
+                nodes[node].firstChild = child;
+            }
+            node = child;
+        }
+        results[i] = stateSetHas(&sets[node * set_words], tg->q0);
+    }
+    
+    FREE(nodes);
+    FREE(sets);
+}
+
+/**
+ * Iternal type of the lazy DFA cache
+ */
+typedef struct LazyDFAImpl LazyDFAImpl;
+
+/**
+ * Type of lazy DFA cache (pointer to the actual data structure)
+ */
+typedef LazyDFAImpl* LazyDFA;
+
+/**
+ * Strucutre containing the lazy DFA cache.
+ *
+ * The sets of states calculated by the backward evaluation (see acceptBitset) are states
+ * of a DFA working on the reversed word. The cache stores these DFA states and their transitions,
+ * both built on demand, so each transition is calculated once and then is a single table lookup.
+ *
+ * The cache has bounded capacity. When it's full the whole cache is flushed
+ * and it's filled again from scratch.
+ */
+struct LazyDFAImpl {
+    TransitionGraph tg;  ///< transition graph of the automaton
+    uint64_t* states;    ///< states[i*setWords] is the set of automaton states corresponding to the DFA state i
+    int* next;           ///< next[i*(C+1) + c] is the DFA state reached from i by letter of class c (column C for class -1, -1 if not calculated yet)
+    int* hashTable;      ///< open addressing hash table of DFA state indices (-1 for empty slots)
+    int hashSize;        ///< size of hashTable (power of two)
+    int count;           ///< number of cached DFA states
+    int capacity;        ///< maximum number of cached DFA states
+    int startState;      ///< DFA state of the accepting states set
+    int flushCount;      ///< number of cache flushes done so far
+};
+
+/*
+ * Helper function for LazyDFA
+ * Calculates hash of the state set
+ */
+static inline uint64_t lazyDFAHash(const uint64_t* set, int words) {
+    uint64_t hash = 1469598103934665603ULL;
+    for(int w=0;w<words;++w) {
+        hash ^= set[w];
+        hash *= 1099511628211ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+/*
+ * Helper function for LazyDFA
+ * Returns index of the DFA state with the given set or -1 if it's not cached.
+ * The @p slot is set to the hash table slot where the set is (or should be) placed.
+ */
+static int lazyDFAFind(LazyDFA dfa, const uint64_t* set, int* slot) {
+    const int words = dfa->tg->setWords;
+    int i = (int)(lazyDFAHash(set, words) & (uint64_t)(dfa->hashSize - 1));
+    while(dfa->hashTable[i] != -1) {
+        if(memcmp(&(dfa->states[dfa->hashTable[i] * words]), set, words * sizeof(uint64_t)) == 0) {
+            *slot = i;
+            return dfa->hashTable[i];
+        }
+        i = (i + 1) & (dfa->hashSize - 1);
+    }
+    *slot = i;
+    return -1;
+}
+
+/*
+ * Helper function for LazyDFA
+ * Adds new DFA state into the given empty hash table slot.
+ * The cache must not be full.
+ */
+static int lazyDFAAdd(LazyDFA dfa, const uint64_t* set, int slot) {
+    const int index = dfa->count++;
+    const int columns = dfa->tg->C + 1;
+    stateSetCopy(&(dfa->states[index * dfa->tg->setWords]), set, dfa->tg->setWords);
+    for(int c=0;c<columns;++c) {
+        dfa->next[index*columns + c] = -1;
+    }
+    dfa->hashTable[slot] = index;
+    return index;
+}
+
+/**
+ * Removes all the cached DFA states and transitions.
+ * Only the start state (set of the accepting states) is left in the cache.
+ *
+ * @param[in] dfa : Lazy DFA cache
+ */
+void lazyDFAFlush(LazyDFA dfa) {
+    int slot;
+    for(int i=0;i<dfa->hashSize;++i) {
+        dfa->hashTable[i] = -1;
+    }
+    dfa->count = 0;
+    lazyDFAFind(dfa, dfa->tg->acceptingMask, &slot);
+    dfa->startState = lazyDFAAdd(dfa, dfa->tg->acceptingMask, slot);
+    ++(dfa->flushCount);
+}
+
+/**
+ * Creates new lazy DFA cache for the given transition graph.
+ * The graph must be already loaded and must not be modified while the cache is used.
+ *
+ * The cache uses at most about @p memory_limit bytes (but always has place for at least two DFA states).
+ *
+ * @param[in] tg           : Transition graph
+ * @param[in] memory_limit : Memory limit of the cache in bytes
+ * @returns New lazy DFA cache
+ */
+LazyDFA newLazyDFA(TransitionGraph tg, size_t memory_limit) {
+    LazyDFA dfa = MALLOCATE(LazyDFAImpl);
+    
+    const size_t state_size = tg->setWords * sizeof(uint64_t) + (tg->C + 5) * sizeof(int);
+    size_t capacity = memory_limit / state_size;
+    if(capacity < 2) {
+        capacity = 2;
+    }
+    if(capacity > (1 << 24)) {
+        capacity = (1 << 24);
+    }
+    
+    dfa->tg = tg;
+    dfa->capacity = (int) capacity;
+    dfa->hashSize = 1;
+    while(dfa->hashSize < 2 * dfa->capacity) {
+        dfa->hashSize *= 2;
+    }
+    dfa->states = MALLOCATE_ARRAY(uint64_t, dfa->capacity * tg->setWords);
+    dfa->next = MALLOCATE_ARRAY(int, dfa->capacity * (tg->C + 1));
+    dfa->hashTable = MALLOCATE_ARRAY(int, dfa->hashSize);
+    
+    lazyDFAFlush(dfa);
+    dfa->flushCount = 0;
+    
+    return dfa;
+}
+
+/**
+ * Frees the lazy DFA cache.
+ *
+ * @param[in] dfa : Lazy DFA cache
+ */
+void freeLazyDFA(LazyDFA dfa) {
+    FREE(dfa->states);
+    FREE(dfa->next);
+    FREE(dfa->hashTable);
+    FREE(dfa);
+}
+
+/**
+ * Returns DFA state reached from the DFA state @p state by the letter of class @p c.
+ * The transition is calculated (see stateSetStepBack) only if it's not cached yet.
+ *
+ * NOTE:
+ *   This function may flush the cache, so all the DFA state indices obtained before are then invalid
+ *   (only the returned one is valid).
+ *
+ * @param[in] dfa    : Lazy DFA cache
+ * @param[in] state  : DFA state
+ * @param[in] c      : Letter class (see letterClassOf)
+ * @returns Next DFA state
+ */
+int lazyDFAStep(LazyDFA dfa, int state, int c) {
+    const int columns = dfa->tg->C + 1;
+    const int column = (c >= 0 && c < columns - 1) ? c : columns - 1;
+    
+    if(dfa->next[state*columns + column] != -1) {
+        return dfa->next[state*columns + column];
+    }
+    
+    const int words = dfa->tg->setWords;
+    uint64_t out[words];
+    int slot;
+    stateSetStepBack(dfa->tg, &(dfa->states[state * words]), c, out);
+    
+    int next_state = lazyDFAFind(dfa, out, &slot);
+    if(next_state == -1) {
+        if(dfa->count >= dfa->capacity) {
+            // Cache is full so flush everything and start from the reached state
+            lazyDFAFlush(dfa);
+            lazyDFAFind(dfa, out, &slot);
+            if(dfa->hashTable[slot] != -1) {
+                return dfa->hashTable[slot];
+            }
+            return lazyDFAAdd(dfa, out, slot);
+        }
+        next_state = lazyDFAAdd(dfa, out, slot);
+    }
+    
+    dfa->next[state*columns + column] = next_state;
+    return next_state;
+}
+
+/**
+ * Calculates accept() running the lazy DFA on the reversed word.
+ * For warm cache it's a single table lookup per letter.
+ *
+ * The cache keeps its contents between calls, so it should be long-lived
+ * and reused for all the words checked against the same automaton.
+ * Gives the same answers as acceptSync.
+ *
+ * @param [in] dfa           : Lazy DFA cache
+ * @param [in] word          : Input word
+ * @return Is the word accepted by automaton defined by transition graph?
+ */
+int acceptLazyDFA(LazyDFA dfa, char* word) {
+    int state = dfa->startState;
+    for(int i=strlen(word)-1;i>=0;--i) {
+        state = lazyDFAStep(dfa, state, letterClassOf(dfa->tg, word[i]));
+    }
+    return stateSetHas(&(dfa->states[state * dfa->tg->setWords]), dfa->tg->q0);
 }
 
 #endif // __AUTOMATON_H__
\ No newline at end of file
@@ -0,0 +1,272 @@
+/** @file
+*
+*  Compiler of automata into native code (C99 standard)
+*
+*  The transition graph is translated into C source in which every letter class becomes
+*  straight-line code computing the set of accepting states one letter earlier in the word
+*  (the same backward evaluation as acceptBitset, but with all rows, targets and bit positions
+*  known at compile time). The source is built with the system compiler into a shared object
+*  that is later loaded with dlopen.
+*
+*  Every shared object exports checksum of the graph it was generated from
+*  (see transitionGraphChecksum), so a stale or foreign object is never used.
+*  If anything fails, the caller should fall back to the generic engines.
+*
+*  @author Piotr Styczyński <piotrsty1@gmail.com>
+*  @copyright MIT
+*  @date 2018-01-21
+*/
+#ifndef __AUTOMATON_COMPILER_H__
+#define __AUTOMATON_COMPILER_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "automaton.h"
+#include "memalloc.h"
+#include "fork.h"
+#include "syslog.h"
+
+/**
+ * Signature of the accept function exported by compiled automaton.
+ */
+typedef int (*CompiledAcceptFn)(const char* word, int word_len);
+
+typedef struct CompiledAutomatonImpl CompiledAutomatonImpl;
+
+/**
+ * Automaton loaded from shared object (see loadCompiledAutomaton)
+ */
+typedef CompiledAutomatonImpl* CompiledAutomaton;
+
+/**
+ * Structure to hold handle of the loaded shared object
+ */
+struct CompiledAutomatonImpl {
+    void* handle;
+    CompiledAcceptFn accept;
+};
+
+/**
+ * Writes to the file the C expression testing membership of the state in the set named n.
+ *
+ * @param[in] out : Output file
+ * @param[in] q   : State
+ */
+static inline void compiledAutomatonEmitTest(FILE* out, int q) {
+    fprintf(out, "(n[%d]>>%d&1)", q >> 6, q & 63);
+}
+
+/**
+ * Writes C source of the evaluator specialized to the transition graph.
+ *
+ * The generated file exports:
+ *   * automaton_compiled_checksum - checksum of the graph (unsigned long long)
+ *   * automaton_compiled_accept   - function of CompiledAcceptFn type
+ *
+ * @param[in] tg  : Transition graph
+ * @param[in] out : Output file
+ */
+void compileTransitionGraphSource(TransitionGraph tg, FILE* out) {
+    const int words = tg->setWords;
+
+    fprintf(out, "/* Automaton compiled to native code. Do not edit. */\n");
+    fprintf(out, "#include <stdint.h>\n\n");
+    fprintf(out, "const unsigned long long automaton_compiled_checksum = 0x%llxULL;\n\n",
+        (unsigned long long) transitionGraphChecksum(tg));
+
+    for(int c=0;c<tg->C;++c) {
+        fprintf(out, "static void step_%d(const uint64_t* n, uint64_t* p) {\n", c);
+        fprintf(out, "    uint64_t w;\n");
+        for(int k=0;k<words;++k) {
+            // Universal states without successors accept unconditionally
+            uint64_t constant_bits = 0;
+            for(int q=k*64;q<tg->Q && q<(k+1)*64;++q) {
+                if(q < tg->U && transitionCount(tg, q, c) == 0) {
+                    constant_bits |= ((uint64_t) 1) << (q & 63);
+                }
+            }
+            fprintf(out, "    w = 0x%llxULL;\n", (unsigned long long) constant_bits);
+            for(int q=k*64;q<tg->Q && q<(k+1)*64;++q) {
+                const int count = transitionCount(tg, q, c);
+                if(count == 0) continue;
+                const int* targets = transitionTargets(tg, q, c);
+                fprintf(out, "    if(");
+                for(int i=0;i<count;++i) {
+                    if(i > 0) {
+                        fprintf(out, (q < tg->U) ? " && " : " || ");
+                    }
+                    compiledAutomatonEmitTest(out, targets[i]);
+                }
+                fprintf(out, ") w |= 1ULL<<%d;\n", q & 63);
+            }
+            fprintf(out, "    p[%d] = w;\n", k);
+        }
+        fprintf(out, "}\n\n");
+    }
+
+    fprintf(out, "int automaton_compiled_accept(const char* word, int word_len) {\n");
+    fprintf(out, "    uint64_t sets[2][%d];\n", words);
+    fprintf(out, "    uint64_t* n = sets[0];\n");
+    fprintf(out, "    uint64_t* p = sets[1];\n");
+    fprintf(out, "    uint64_t* t;\n");
+    for(int k=0;k<words;++k) {
+        fprintf(out, "    n[%d] = 0x%llxULL;\n", k, (unsigned long long) tg->acceptingMask[k]);
+    }
+    fprintf(out, "    for(int i=word_len-1;i>=0;--i) {\n");
+    fprintf(out, "        switch((unsigned char)(word[i]-'a')) {\n");
+    for(int c=0;c<tg->C;++c) {
+        fprintf(out, "           ");
+        for(int a=0;a<tg->A;++a) {
+            if(tg->letterClass[a] == c) {
+                fprintf(out, " case %d:", a);
+            }
+        }
+        fprintf(out, " step_%d(n, p); break;\n", c);
+    }
+    // Letters without transitions (also the ones outside of the alphabet): only universal states accept
+    fprintf(out, "            default:\n");
+    for(int k=0;k<words;++k) {
+        uint64_t universal_bits = 0;
+        for(int q=k*64;q<tg->U && q<(k+1)*64;++q) {
+            universal_bits |= ((uint64_t) 1) << (q & 63);
+        }
+        fprintf(out, "                p[%d] = 0x%llxULL;\n", k, (unsigned long long) universal_bits);
+    }
+    fprintf(out, "                break;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        t = n; n = p; p = t;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return ");
+    compiledAutomatonEmitTest(out, tg->q0);
+    fprintf(out, ";\n}\n");
+}
+
+/**
+ * Compiles transition graph into shared object using COMPILED_AUTOMATON_CC.
+ * The intermediate C source is written to <so_path>.tmp.c and removed afterwards.
+ * The shared object is built as <so_path>.tmp and renamed to @p so_path when it's complete,
+ * so the processes loading @p so_path never see partially written file.
+ *
+ * @param[in] tg      : Transition graph
+ * @param[in] so_path : Path of the shared object to create
+ * @returns If the compilation succeeded?
+ */
+int compileTransitionGraph(TransitionGraph tg, const char* so_path) {
+    char src_path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    if(snprintf(src_path, sizeof(src_path), "%s.tmp.c", so_path) >= (int) sizeof(src_path) ||
+       snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", so_path) >= (int) sizeof(tmp_path)) {
+        log_err(AUTOMATON, "Path of the compiled automaton is too long.");
+        return 0;
+    }
+
+    FILE* src = fopen(src_path, "w");
+    if(src == NULL) {
+        log_err(AUTOMATON, "Failed to create automaton source file %s.", src_path);
+        return 0;
+    }
+    compileTransitionGraphSource(tg, src);
+    if(fclose(src) != 0) {
+        log_err(AUTOMATON, "Failed to write automaton source file %s.", src_path);
+        unlink(src_path);
+        return 0;
+    }
+
+    pid_t pid;
+    const int status = processFork(&pid);
+    if(status == -1) {
+        log_err(AUTOMATON, "Failed to fork the compiler.");
+        unlink(src_path);
+        return 0;
+    }
+    if(status == 1) {
+        char* const argv[] = { COMPILED_AUTOMATON_CC, "-O2", "-shared", "-fPIC", "-o", tmp_path, src_path, NULL };
+        execvp(COMPILED_AUTOMATON_CC, argv);
+        _exit(127);
+    }
+
+    int wstatus;
+    while(waitpid(pid, &wstatus, 0) == -1) {
+        if(errno != EINTR) {
+            log_err(AUTOMATON, "Failed to wait for the compiler.");
+            unlink(src_path);
+            return 0;
+        }
+    }
+    unlink(src_path);
+
+    if(!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+        log_err(AUTOMATON, "Compiler %s failed to build %s.", COMPILED_AUTOMATON_CC, so_path);
+        unlink(tmp_path);
+        return 0;
+    }
+    if(rename(tmp_path, so_path) != 0) {
+        log_err(AUTOMATON, "Failed to move the compiled automaton to %s.", so_path);
+        unlink(tmp_path);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Loads automaton compiled by compileTransitionGraph.
+ * Returns NULL if the shared object cannot be loaded or was compiled from a different graph.
+ *
+ * @param[in] tg      : Transition graph the shared object should be compiled from
+ * @param[in] so_path : Path of the shared object
+ * @returns Loaded automaton or NULL
+ */
+CompiledAutomaton loadCompiledAutomaton(TransitionGraph tg, const char* so_path) {
+    void* handle = dlopen(so_path, RTLD_NOW | RTLD_LOCAL);
+    if(handle == NULL) {
+        log_err(AUTOMATON, "Failed to load compiled automaton: %s", dlerror());
+        return NULL;
+    }
+
+    const unsigned long long* checksum = (const unsigned long long*) dlsym(handle, "automaton_compiled_checksum");
+    void* accept_sym = dlsym(handle, "automaton_compiled_accept");
+    if(checksum == NULL || accept_sym == NULL) {
+        log_err(AUTOMATON, "Compiled automaton %s has no required symbols.", so_path);
+        dlclose(handle);
+        return NULL;
+    }
+    if(*checksum != (unsigned long long) transitionGraphChecksum(tg)) {
+        log_err(AUTOMATON, "Compiled automaton %s does not match the transition graph.", so_path);
+        dlclose(handle);
+        return NULL;
+    }
+
+    CompiledAutomaton ca = MALLOCATE(CompiledAutomatonImpl);
+    ca->handle = handle;
+    // ISO C has no conversion between object and function pointers
+    memcpy(&(ca->accept), &accept_sym, sizeof(accept_sym));
+    return ca;
+}
+
+/**
+ * Frees the compiled automaton and unloads its shared object.
+ *
+ * @param[in] ca : Compiled automaton
+ */
+void freeCompiledAutomaton(CompiledAutomaton ca) {
+    dlclose(ca->handle);
+    FREE(ca);
+}
+
+/**
+ * Check if the compiled automaton accepts the given word.
+ *
+ * @param[in] ca   : Compiled automaton
+ * @param[in] word : Word to be parsed
+ * @returns If the word is accepted?
+ */
+int acceptCompiled(CompiledAutomaton ca, char* word) {
+    return ca->accept(word, strlen(word));
+}
+
+#endif // __AUTOMATON_COMPILER_H__
@@ -24,19 +24,47 @@
 #define SERVER_TERMINATE_ON_RUN_FAILURE   0
 
 /**
- * @def RUN_WORKLOAD_LIMIT
- *    Limit of the workload per wroker process in execution of async accept.
+ * @def RUN_NODE_COST
+ *    Initial estimate of the cost of the run tree node expansion (in nanoseconds).
  *
- *    This means that fork's will occur only after parsing at least RUN_WORKLOAD_LIMIT nodes.
- *    Higher value means less worker processes.
+ *    The workers measure the real cost and report it to the validator, which passes
+ *    the learned value to the next workers (see AcceptTuning in automaton.h).
+ *    This value is used only until the first measurement.
  */
-#define RUN_WORKLOAD_LIMIT      5
+#define RUN_NODE_COST           20
+
+/**
+ * @def RUN_SPAWN_COST
+ *    Initial estimate of the cost of the fork of the async accept subprocess (in nanoseconds).
+ *
+ *    Async accept forks only at the nodes whose expected subtree work exceeds this cost.
+ *    Like RUN_NODE_COST it's measured by the workers and learned by the validator.
+ */
+#define RUN_SPAWN_COST          300000
+
+/**
+ * @def RUN_THREAD_COST
+ *    Initial estimate of the overhead of single thread of acceptThreads (in nanoseconds):
+ *    its start, the preallocated tasks and the synchronization.
+ *
+ *    The dispatcher chooses acceptThreads only if the run tree split between the threads pays off this overhead
+ *    (see automaton_dispatch.h). Like RUN_NODE_COST it's measured by the workers and learned by the validator.
+ */
+#define RUN_THREAD_COST         500000
+
+/**
+ * @def RUN_TUNING_MIN_NODES
+ *    Minimal number of the run tree nodes expanded by the worker for its node cost measurement to be reported.
+ *    (shorter measurements are dominated by the timer resolution)
+ */
+#define RUN_TUNING_MIN_NODES    10000
 
 /**
  * @def RUN_FORK_LIMIT
  *    Limit of the self-forks done per worker proccess.
  *
  *    It approximated upper limit of self-forks done by worker.
+ *    The actual limit is lowered so that the number of the processes is about twice the number of online processors.
  */
 #define RUN_FORK_LIMIT          22
 
@@ -45,7 +73,7 @@
  *    Limit of the number of processes per server.
  *
  *    The server tries to throttle the number of spawned processes, so that number of processes after
- *    reaching RUN_WORKLOAD_LIMIT is constant or rises by negglible amounts randomly.
+ *    reaching the async accept split threshold is constant or rises by negglible amounts randomly.
  *    (this value is only an estimate not exact maximum value of launched processes)
  *
  *    Use this setting to limit estimated maximum amount of fork's done by server.
@@ -53,16 +81,70 @@
 #define SERVER_PROCESS_LIMIT    20
 
 /**
- * @def MAX_Q
- *    Defines maximum number of automaton states
+ * @def SERVER_INLINE_TREE_LIMIT
+ *    Words whose run tree has at most so many nodes (see estimateRunTree in automaton.h) are evaluated
+ *    by the validator itself, as that's cheaper than spawning the run worker.
+ *    Set to 0 to send all the words to the workers.
+ */
+#define SERVER_INLINE_TREE_LIMIT 4096
+
+/**
+ * @def USE_SHARED_GRAPH_IMAGE
+ *    If set to 1 then validator writes the parsed automaton into a POSIX shared memory object
+ *    (see automaton_image.h) and the run workers map it read-only instead of receiving
+ *    and parsing the description for each word. If sharing fails the description is sent as before.
+ */
+#define USE_SHARED_GRAPH_IMAGE  1
+
+/**
+ * @def LAZY_DFA_MEMORY_LIMIT
+ *    Defines memory limit (in bytes) of a single lazy DFA cache (see LazyDFA in automaton.h)
+ *    When the cache reaches the limit it is flushed.
+ */
+#define LAZY_DFA_MEMORY_LIMIT  (8 * 1024 * 1024)
+
+/**
+ * @def COMPILED_AUTOMATON_CC
+ *    System C compiler used to build automata compiled to native code (validator -c)
+ *    The compiler is looked up in PATH.
+ */
+#define COMPILED_AUTOMATON_CC  "cc"
+
+/**
+ * @def COMPILED_AUTOMATON_PATH_PREFIX
+ *    Prefix of the path of the shared object produced by validator -c and loaded by the run workers.
+ *    The validator appends its pid and .so suffix (e.g. ./automaton_compiled1234.so), so the validators started
+ *    in the same directory do not share the file. The shared object is removed when the validator exits.
  */
-#define MAX_Q                  107
+#define COMPILED_AUTOMATON_PATH_PREFIX "./automaton_compiled"
 
 /**
- * @def MAX_A
- *    Defines maximum number of alphabet characters
+ * @def LOADER_THREADS_COUNT
+ *    Number of threads parsing the transition lines of the automaton description (see loadTransitionGraph in automaton.h).
+ *    If set to 0 then the number of online processors is used. Set to 1 to parse in the calling thread only.
  */
-#define MAX_A                  37
+#define LOADER_THREADS_COUNT    0
+
+/**
+ * @def LOADER_THREADS_MIN_BYTES
+ *    Minimal size (in bytes) of the part of the transition lines parsed by single loader thread,
+ *    so small descriptions are parsed by fewer threads (or by the calling thread only).
+ */
+#define LOADER_THREADS_MIN_BYTES (4 * 1024 * 1024)
+
+/**
+ * @def USE_AUTOMATON_MINIMIZATION
+ *    If set to 1 then validator reduces the automaton before sending it to the run workers
+ *    (bisimilar states are merged and unreachable states removed, see minimizeTransitionGraph in automaton.h).
+ */
+#define USE_AUTOMATON_MINIMIZATION 1
+
+/**
+ * @def AUTOMATON_MINIMIZATION_WORK_LIMIT
+ *    Limit of the work (in visited states, letters and transitions) done by minimizeTransitionGraph.
+ *    When the limit is exceeded the automaton is used without reduction.
+ */
+#define AUTOMATON_MINIMIZATION_WORK_LIMIT (256LL * 1024 * 1024)
 
 /**
  * @def LINE_BUF_SIZE
@@ -72,10 +154,18 @@
 
 /**
  * @def FILE_BUF_SIZE
- *    Defines maximum number of bytes in single file
+ *    Defines maximum number of bytes of the graph description sent to the worker through the pipe
+ *    (used only when the shared graph image is not available)
  */
 #define FILE_BUF_SIZE          3000007
 
+/**
+ * @def STDIN_READ_BLOCK_SIZE
+ *    Size (in bytes) of the blocks in which the automaton description is read from the standard input
+ *    (see loadTransitionGraphDescFromStdin in automaton.h). The description itself has no size limit.
+ */
+#define STDIN_READ_BLOCK_SIZE  (1024 * 1024)
+
 /**
  * @def MSG_QUEUE_SIZE
  *    Defines maximum number of messages in a msgQueue
@@ -84,11 +174,158 @@
 
 /**
  * @def USE_ASYNC_ACCEPT
- *    If set to 1 then async accept function will be used.
- *    If set to 0 then synchronic version will be used and no run subprocess will be spawned.
+ *    If set to 1 then async accept function (forking run subprocesses) can be requested with -e async.
+ *    It's never chosen automatically (see automaton_dispatch.h). If set to 0 then such requests
+ *    fall back to the automatic choice and no run subprocess will be spawned.
  */
 #define USE_ASYNC_ACCEPT        1
 
+/**
+ * @def USE_ITERATIVE_ACCEPT
+ *    If set to 1 then iterative accept (acceptIterative) with explicit stack will be used instead of
+ *    the synchronic one for words longer than ACCEPT_DISPATCH_RECURSION_DEPTH.
+ *    It uses no recursion, so long words cannot overflow the call stack.
+ */
+#define USE_ITERATIVE_ACCEPT    1
+
+/**
+ * @def USE_THREADS_ACCEPT
+ *    If set to 1 then work-stealing multithreaded accept (acceptThreads) can be chosen by the dispatcher
+ *    (see automaton_dispatch.h). The run tree is split into tasks executed by ACCEPT_THREADS_COUNT threads
+ *    and no run subprocesses are spawned.
+ */
+#define USE_THREADS_ACCEPT      1
+
+/**
+ * @def ACCEPT_THREADS_COUNT
+ *    Number of threads used by acceptThreads.
+ *    If set to 0 then the number of online processors is used.
+ */
+#define ACCEPT_THREADS_COUNT    0
+
+/**
+ * @def ACCEPT_THREADS_TASK_LIMIT
+ *    Maximum number of live tasks of acceptThreads.
+ *    When the limit is reached subtrees are no longer split and are evaluated by the thread that owns them.
+ */
+#define ACCEPT_THREADS_TASK_LIMIT 16384
+
+/**
+ * @def ACCEPT_THREADS_TASK_BUDGET
+ *    Number of run tree nodes evaluated by acceptThreads thread between checks for
+ *    cancellation and idle threads (when there are idle threads the current task is split).
+ *    Higher value means less tasks and less synchronization.
+ */
+#define ACCEPT_THREADS_TASK_BUDGET 4096
+
+/**
+ * @def ACCEPT_STREAM_CLAUSE_LIMIT
+ *    Maximum number of clauses of the formula kept by the streaming accept (see automaton_stream.h).
+ *    When the limit is reached the rest of the word is buffered and evaluated backwards on demand.
+ */
+#define ACCEPT_STREAM_CLAUSE_LIMIT 4096
+
+/**
+ * @def ACCEPT_STREAM_PENDING_LIMIT
+ *    Maximum number of letters buffered by the streaming accept after its formula was frozen
+ *    (see ACCEPT_STREAM_CLAUSE_LIMIT). Each verdict steps back through all the buffered letters.
+ *    When the limit is exceeded the stream stops accepting letters and the word must be evaluated otherwise.
+ */
+#define ACCEPT_STREAM_PENDING_LIMIT (1024 * 1024)
+
+/**
+ * @def USE_SESSION_SNAPSHOTS
+ *    If set to 1 then validator keeps the streaming evaluator (see automaton_stream.h) per tester session.
+ *    A word extending the previous word of the same tester is answered by the server itself
+ *    by feeding only the appended letters, so no worker is spawned for it.
+ */
+#define USE_SESSION_SNAPSHOTS   1
+
+/**
+ * @def SERVER_SNAPSHOT_WORK_LIMIT
+ *    Limit of the work (in expanded states and compared clauses, see acceptStreamSetWorkLimit
+ *    in automaton_stream.h) done by the validator to answer single word from the session snapshot.
+ *    When it's exceeded the snapshot is dropped and the word is sent to the worker,
+ *    so the server loop is never blocked by large stream formulas.
+ */
+#define SERVER_SNAPSHOT_WORK_LIMIT 4096
+
+/**
+ * @def USE_MEMO_ACCEPT
+ *    If set to 1 then memoized accept (acceptMemo) can be chosen by the dispatcher (see automaton_dispatch.h).
+ *    It expands each (state, position in word) pair only once and spawns no run subprocesses.
+ */
+#define USE_MEMO_ACCEPT         1
+
+/**
+ * @def ACCEPT_MEMO_MEMORY_LIMIT
+ *    Maximum size (in bytes) of the memo table of acceptMemo (|w| * Q bytes).
+ *    For larger tables the dispatcher does not choose the memoized accept and
+ *    acceptMemo itself falls back to acceptBitset.
+ */
+#define ACCEPT_MEMO_MEMORY_LIMIT (256 * 1024 * 1024)
+
+/**
+ * @def USE_BITSET_ACCEPT
+ *    If set to 1 then backward bitset accept (acceptBitset) can be chosen by the dispatcher (see automaton_dispatch.h).
+ *    It evaluates the word from right to left on sets of states with no recursion and no forks.
+ */
+#define USE_BITSET_ACCEPT       1
+
+/**
+ * @def USE_LAZY_DFA_ACCEPT
+ *    If set to 1 then validator keeps the lazy DFA cache (see LazyDFA in automaton.h) of the automaton
+ *    and answers the words for which the dispatcher (see automaton_dispatch.h) chooses acceptLazyDFA.
+ *    It pays off for words much longer than the number of states.
+ */
+#define USE_LAZY_DFA_ACCEPT     1
+
+/**
+ * @def USE_STEP_TABLES
+ *    If set to 1 then the step tables (see automaton_simd.h) are built with the transition graph,
+ *    so the backward step on sets of states (used by bitset, lazy DFA and streaming accept)
+ *    is done by the vectorized kernel selected for the processor.
+ */
+#define USE_STEP_TABLES         1
+
+/**
+ * @def STEP_TABLES_MEMORY_LIMIT
+ *    Maximum size (in bytes) of the step tables of single transition graph.
+ *    Larger automata use the scalar backward step without the tables.
+ */
+#define STEP_TABLES_MEMORY_LIMIT (16 * 1024 * 1024)
+
+/**
+ * @def STEP_KERNEL_MAX_LANES
+ *    Maximum width (in 64-bit words) of the step kernel: 8 allows AVX-512, 4 limits it to AVX2, 2 to SSE2
+ *    and 1 forces the scalar kernel.
+ */
+#define STEP_KERNEL_MAX_LANES   8
+
+/**
+ * @def USE_FIXED_WIDTH_ENGINES
+ *    If set to 1 then the backward step and the bitset accept are specialized for automata with
+ *    Q <= 64, Q <= 128 and Q <= 256 (sets of fixed number of words, see selectTransitionGraphVariant in automaton.h),
+ *    with the step kernel selected for the processor inlined.
+ *    Larger automata (or the ones without the step tables) use the dynamic engines.
+ */
+#define USE_FIXED_WIDTH_ENGINES 1
+
+/**
+ * @def ACCEPT_LOCKSTEP_WORDS
+ *    Width (in 64-bit words) of the lane masks of acceptLockstep, so the number of the words
+ *    evaluated together is 64 times this value. The masks are processed with vector instructions
+ *    when the compiler can use them.
+ */
+#define ACCEPT_LOCKSTEP_WORDS   4
+
+/**
+ * @def ACCEPT_DISPATCH_RECURSION_DEPTH
+ *    Maximum length of the word evaluated by the recursive synchronic accept when it's chosen by the dispatcher.
+ *    Longer words use the iterative one (if USE_ITERATIVE_ACCEPT is set).
+ */
+#define ACCEPT_DISPATCH_RECURSION_DEPTH 10000
+
 /**
  * @def DEBUG_TRANSFERRED_GRAPH
  *    If set to 1 then transition graph is printed in each run.
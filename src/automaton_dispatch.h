@@ -0,0 +1,278 @@
+/** @file
+*
+*  Runtime selection of the accept engine (C99 standard)
+*
+*  All the engines give the same answers, but their costs differ a lot:
+*    * plain recursion (sync, iterative) - size of the run tree, no setup
+*    * memo    - number of reachable (state, position) pairs, memo of |w| * Q bytes (at most ACCEPT_MEMO_MEMORY_LIMIT)
+*    * bitset  - |w| steps on the whole sets of states
+*    * lazy    - |w| table lookups, but each new DFA state costs the bitset step
+*                (only with the long-lived cache of the caller, see LazyDFA in automaton.h)
+*    * threads - the run tree split between the processors, but the threads must be started
+*                (the overhead of the threads and the node cost are learned, see AcceptTuning in automaton.h)
+*    * async   - the run tree split between the processes (never chosen automatically, as forks are expensive)
+*
+*  selectAcceptEngine estimates these costs from the automaton statistics (number of states,
+*  branching factor, universal ratio) and the word and picks the cheapest engine.
+*  The size of the run tree is counted by the forward pass over the word (see estimateRunTree),
+*  the other estimates are rough, they are meant only to tell the engines apart when they differ
+*  by orders of magnitude.
+*
+*  Only the engines enabled in automaton_config.h (USE_*_ACCEPT) are taken into account.
+*  The lazy DFA is taken into account only when the caller passes its cache: the cache pays off
+*  only when it's reused for many words, so it's never built for a single word
+*  (the validator keeps one for its graph, the run workers pass NULL).
+*  The engine can be also forced by name (see acceptEngineFromName).
+*
+*  @author Piotr Styczyński <piotrsty1@gmail.com>
+*  @copyright MIT
+*  @date 2018-01-21
+*/
+#ifndef __AUTOMATON_DISPATCH_H__
+#define __AUTOMATON_DISPATCH_H__
+
+#include <float.h>
+#include <string.h>
+#include <unistd.h>
+#include "automaton.h"
+#include "automaton_threads.h"
+#include "syslog.h"
+
+/**
+ * Accept engines
+ */
+typedef enum AcceptEngine {
+    ACCEPT_ENGINE_AUTO = 0,  ///< chosen by selectAcceptEngine
+    ACCEPT_ENGINE_SYNC,      ///< acceptSync
+    ACCEPT_ENGINE_ITERATIVE, ///< acceptIterative
+    ACCEPT_ENGINE_ASYNC,     ///< acceptAsync
+    ACCEPT_ENGINE_MEMO,      ///< acceptMemo
+    ACCEPT_ENGINE_BITSET,    ///< acceptBitset
+    ACCEPT_ENGINE_LAZY,      ///< acceptLazyDFA
+    ACCEPT_ENGINE_THREADS,   ///< acceptThreads
+    ACCEPT_ENGINE_COUNT      ///< number of the values (not an engine)
+} AcceptEngine;
+
+/*
+ * Names of the engines (indexed by AcceptEngine)
+ */
+static const char* const acceptEngineNames[ACCEPT_ENGINE_COUNT] = {
+    "auto", "sync", "iterative", "async", "memo", "bitset", "lazy", "threads"
+};
+
+/**
+ * Structure to hold the estimated costs of the engines
+ * (in abstract units, roughly the number of visited states).
+ */
+typedef struct AcceptEngineStats {
+    double branching;      ///< average number of successors of the non-empty rows
+    double universalRatio; ///< part of the states being universal
+    double treeCost;       ///< expected number of the run tree nodes visited by plain recursion
+    double memoCost;       ///< estimated cost of acceptMemo
+    double bitsetCost;     ///< estimated cost of acceptBitset
+    double lazyCost;       ///< estimated cost of acceptLazyDFA
+    double threadsCost;    ///< estimated cost of acceptThreads (per thread, with the learned overhead of the threads)
+} AcceptEngineStats;
+
+/**
+ * Returns the name of the engine.
+ *
+ * @param[in] engine : Accept engine
+ * @returns Name of the engine
+ */
+const char* acceptEngineName(AcceptEngine engine) {
+    if(engine < 0 || engine >= ACCEPT_ENGINE_COUNT) {
+        return "unknown";
+    }
+    return acceptEngineNames[engine];
+}
+
+/**
+ * Finds the engine by its name.
+ *
+ * @param[in] name : Name of the engine (one of: auto, sync, iterative, async, memo, bitset, lazy, threads)
+ * @returns The engine or ACCEPT_ENGINE_COUNT if there's no such engine
+ */
+AcceptEngine acceptEngineFromName(const char* name) {
+    for(int i=0;i<ACCEPT_ENGINE_COUNT;++i) {
+        if(strcmp(acceptEngineNames[i], name) == 0) {
+            return (AcceptEngine) i;
+        }
+    }
+    return ACCEPT_ENGINE_COUNT;
+}
+
+/**
+ * Estimates the costs of the engines for the word.
+ *
+ * The run tree is counted by estimateRunTree. As the existential states stop at the first
+ * accepting successor (and universal at the first rejecting one) the recursion is expected
+ * to visit only part of it: all the successors of universal states and half of the successors
+ * of existential states are assumed. The counting stops when the run tree is surely more expensive
+ * than the engines that do not depend on its size.
+ *
+ * @param[in] tg       : Transition graph
+ * @param[in] dfa      : Long-lived lazy DFA cache of the graph (NULL if there's none)
+ * @param[in] word     : Input word
+ * @param[in] stats    : Pointer to the structure receiving the estimates
+ */
+void acceptEngineEstimate(const TransitionGraph tg, const LazyDFA dfa, const char* word, AcceptEngineStats* stats) {
+    const int word_len = strlen(word);
+
+    // The statistics of the graph are computed once (see transitionGraphStatistics)
+    stats->branching = tg->branching;
+    stats->universalRatio = tg->universalRatio;
+    const double fanout = (stats->branching > 1.0) ? stats->branching : 1.0;
+
+    // Reachable (state, position) pairs (at most Q per position), level by level
+    double reachable = 1.0;
+    stats->memoCost = 1.0;
+    for(int i=0;i<word_len;++i) {
+        reachable *= fanout;
+        if(reachable > tg->Q) {
+            reachable = tg->Q;
+        }
+        stats->memoCost += reachable * fanout;
+    }
+    stats->memoCost += (double) word_len * tg->Q / 64.0;
+
+    // Single backward step visits all the states and the average row
+    const double step = tg->Q + (double) tg->edgeCount / (tg->C > 0 ? tg->C : 1);
+    stats->bitsetCost = word_len * step;
+
+    // The lazy DFA pays the bitset step only for the DFA states not cached yet
+    double dfaStates = (double) tg->Q * (tg->C + 1);
+    if(dfa != NULL) {
+        dfaStates -= dfa->count;
+    }
+    if(dfaStates > word_len) {
+        dfaStates = word_len;
+    }
+    if(dfaStates < 1.0) {
+        dfaStates = 1.0;
+    }
+    stats->lazyCost = (dfa != NULL) ? word_len + dfaStates * step : DBL_MAX;
+
+    long processors = (ACCEPT_THREADS_COUNT > 0) ? ACCEPT_THREADS_COUNT : sysconf(_SC_NPROCESSORS_ONLN);
+    if(processors <= 0) {
+        processors = 1;
+    }
+
+    // Count the run tree (only as long as it can be cheaper than the other engines)
+    double limit = stats->bitsetCost;
+    if(stats->memoCost < limit) {
+        limit = stats->memoCost;
+    }
+    if(stats->lazyCost < limit) {
+        limit = stats->lazyCost;
+    }
+    limit *= 2 * processors;
+    long long pairs = 0;
+    const double tree = estimateRunTree(tg, word, word_len, limit, &pairs);
+    stats->treeCost = tree * (stats->universalRatio + (1.0 - stats->universalRatio) / 2.0);
+    if(tree <= limit) {
+        // The reachable pairs are known exactly
+        stats->memoCost = pairs * fanout + (double) word_len * tg->Q / 64.0;
+    }
+
+    // The threads share the run tree, but each thread costs the overhead learned from the previous runs
+    // (start, preallocated tasks, synchronization), expressed in the run tree nodes
+    const double threadNodes = acceptTuning.threadCost / (acceptTuning.nodeCost > 0 ? acceptTuning.nodeCost : 1);
+    stats->threadsCost = stats->treeCost / processors + processors * threadNodes;
+}
+
+/**
+ * Chooses the engine with the lowest estimated cost for the word
+ * (see acceptEngineEstimate). Only the engines enabled in automaton_config.h are taken into account.
+ *
+ * @param[in] tg       : Transition graph
+ * @param[in] dfa      : Long-lived lazy DFA cache of the graph (NULL if there's none)
+ * @param[in] word     : Input word
+ * @param[in] stats    : Pointer to the structure receiving the estimates (can be NULL)
+ * @returns The chosen engine
+ */
+AcceptEngine selectAcceptEngine(const TransitionGraph tg, const LazyDFA dfa, const char* word, AcceptEngineStats* stats) {
+    AcceptEngineStats local;
+    if(stats == NULL) {
+        stats = &local;
+    }
+    acceptEngineEstimate(tg, dfa, word, stats);
+    const int word_len = strlen(word);
+
+    // Plain recursion is the fallback (the iterative one for words too long for the call stack)
+    AcceptEngine best = ACCEPT_ENGINE_SYNC;
+    double bestCost = stats->treeCost;
+#if USE_ITERATIVE_ACCEPT == 1
+    if(word_len > ACCEPT_DISPATCH_RECURSION_DEPTH) {
+        best = ACCEPT_ENGINE_ITERATIVE;
+    }
+#endif
+
+#if USE_MEMO_ACCEPT == 1
+    // The memoized accept is recursive as well and its table must fit in the memory limit
+    if(stats->memoCost < bestCost && word_len <= ACCEPT_DISPATCH_RECURSION_DEPTH && (double) word_len * tg->Q <= ACCEPT_MEMO_MEMORY_LIMIT) {
+        best = ACCEPT_ENGINE_MEMO;
+        bestCost = stats->memoCost;
+    }
+#endif
+#if USE_BITSET_ACCEPT == 1
+    if(stats->bitsetCost < bestCost) {
+        best = ACCEPT_ENGINE_BITSET;
+        bestCost = stats->bitsetCost;
+    }
+#endif
+#if USE_LAZY_DFA_ACCEPT == 1
+    if(dfa != NULL && stats->lazyCost < bestCost) {
+        best = ACCEPT_ENGINE_LAZY;
+        bestCost = stats->lazyCost;
+    }
+#endif
+#if USE_THREADS_ACCEPT == 1
+    if(stats->threadsCost < bestCost) {
+        best = ACCEPT_ENGINE_THREADS;
+        bestCost = stats->threadsCost;
+    }
+#endif
+
+    return best;
+}
+
+/**
+ * Calculates accept() with the given engine.
+ * For ACCEPT_ENGINE_AUTO the engine is chosen by selectAcceptEngine.
+ * ACCEPT_ENGINE_LAZY without the cache falls back to acceptBitset
+ * (it's the same backward evaluation, without the cache allocated for a single word).
+ *
+ * @param [in] tg            : Transition graph
+ * @param [in] dfa           : Long-lived lazy DFA cache of the graph (NULL if there's none)
+ * @param [in] engine        : Accept engine
+ * @param [in] word          : Input word
+ * @return Is the word accepted by automaton defined by transition graph?
+ */
+int acceptWithEngine(TransitionGraph tg, LazyDFA dfa, AcceptEngine engine, char* word) {
+    if(engine == ACCEPT_ENGINE_AUTO) {
+        engine = selectAcceptEngine(tg, dfa, word, NULL);
+    }
+
+    switch(engine) {
+        case ACCEPT_ENGINE_ITERATIVE:
+            return acceptIterative(tg, word);
+        case ACCEPT_ENGINE_ASYNC:
+            return acceptAsync(tg, word);
+        case ACCEPT_ENGINE_MEMO:
+            return acceptMemo(tg, word);
+        case ACCEPT_ENGINE_BITSET:
+            return acceptBitset(tg, word);
+        case ACCEPT_ENGINE_LAZY:
+            if(dfa != NULL) {
+                return acceptLazyDFA(dfa, word);
+            }
+            return acceptBitset(tg, word);
+        case ACCEPT_ENGINE_THREADS:
+            return acceptThreads(tg, word);
+        default:
+            return acceptSync(tg, word);
+    }
+}
+
+#endif // __AUTOMATON_DISPATCH_H__
@@ -0,0 +1,543 @@
+/** @file
+*
+*  Position-independent image of the transition graph (C99 standard)
+*
+*  The image is a single block of memory with the header followed by all the arrays of the loaded
+*  transition graph (transitions, dense rows, analysis bounds and step tables). The arrays are referenced
+*  by offsets from the start of the image, so the image can be mapped at any address.
+*
+*  The validator parses the automaton once, writes its image into the POSIX shared memory object
+*  (see shareTransitionGraphImage) and the run workers map it read-only (see mapTransitionGraphImage).
+*  The graph opened from the image points directly into the mapping, so the worker setup does not depend
+*  on the size of the automaton: there is nothing to receive, parse or allocate.
+*
+*  The same image is stored in .autb files (see saveTransitionGraphImageFile), so the automaton
+*  converted once is later loaded with a single mmap instead of parsing its textual description.
+*
+*  The image is specific to the machine that wrote it (byte order, step tables layout).
+*
+*  @author Piotr Styczyński <piotrsty1@gmail.com>
+*  @copyright MIT
+*  @date 2018-01-21
+*/
+#ifndef __AUTOMATON_IMAGE_H__
+#define __AUTOMATON_IMAGE_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "automaton.h"
+#include "automaton_simd.h"
+#include "memalloc.h"
+#include "syslog.h"
+
+/**
+ * @def TRANSITION_GRAPH_IMAGE_MAGIC
+ *    First 8 bytes of the image ("FAUTIMG" followed by zero byte, little endian)
+ */
+#define TRANSITION_GRAPH_IMAGE_MAGIC   0x00474D4954554146ULL
+
+/**
+ * @def TRANSITION_GRAPH_IMAGE_VERSION
+ *    Version of the image layout (images of other versions are rejected)
+ */
+#define TRANSITION_GRAPH_IMAGE_VERSION 2
+
+/**
+ * @def TRANSITION_GRAPH_IMAGE_ALIGN
+ *    Alignment of the arrays in the image (in bytes)
+ */
+#define TRANSITION_GRAPH_IMAGE_ALIGN   64
+
+/**
+ * Arrays stored in the image
+ */
+typedef enum TransitionGraphImageArray {
+    TG_IMAGE_ROW_OFFSET = 0,
+    TG_IMAGE_EDGES,
+    TG_IMAGE_DENSE_ROW,
+    TG_IMAGE_DENSE_MASKS,
+    TG_IMAGE_ACCEPTING_STATES,
+    TG_IMAGE_ACCEPTING_MASK,
+    TG_IMAGE_MIN_ACCEPT,
+    TG_IMAGE_MAX_ACCEPT,
+    TG_IMAGE_MIN_REJECT,
+    TG_IMAGE_MAX_REJECT,
+    TG_IMAGE_STEP_TABLES,
+    TG_IMAGE_STEP_MASKS,
+    TG_IMAGE_ARRAY_COUNT  ///< number of the arrays (not an array)
+} TransitionGraphImageArray;
+
+/**
+ * Header of the image
+ */
+typedef struct TransitionGraphImageHeader {
+    uint64_t magic;                          ///< TRANSITION_GRAPH_IMAGE_MAGIC
+    uint32_t version;                        ///< TRANSITION_GRAPH_IMAGE_VERSION
+    uint32_t headerSize;                     ///< size of this header in bytes
+    uint64_t size;                           ///< size of the whole image in bytes
+    uint64_t checksum;                       ///< transitionGraphChecksum of the graph
+    uint64_t imageChecksum;                  ///< checksum of the whole image (see transitionGraphImageChecksum)
+    int32_t A;                               ///< size of the alphabet
+    int32_t C;                               ///< number of the letter classes
+    int32_t Q;                               ///< number of states
+    int32_t U;                               ///< number of universal states
+    int32_t F;                               ///< number of final states
+    int32_t q0;                              ///< initial state
+    int32_t setWords;                        ///< number of 64-bit words in a set of states
+    int32_t edgeCount;                       ///< number of edges
+    int32_t denseCount;                      ///< number of dense rows
+    int32_t stepChunks;                      ///< number of 8-state chunks in the step tables
+    int32_t stepStride;                      ///< number of words in a row of the step tables
+    int32_t reserved;                        ///< unused (zero)
+    int32_t letterClass[256];                ///< classes of the letters
+    uint64_t offset[TG_IMAGE_ARRAY_COUNT];   ///< offsets of the arrays from the start of the image (0 for missing arrays)
+    uint64_t length[TG_IMAGE_ARRAY_COUNT];   ///< sizes of the arrays in bytes
+} TransitionGraphImageHeader;
+
+/**
+ * Calculates the checksum of the image (FNV-1a of all the bytes, the header included).
+ * The checksum fields of the header are hashed as zeros.
+ *
+ * @param[in] image : Image written by saveTransitionGraphImage (at least the header)
+ * @param[in] size  : Size of the image in bytes
+ * @returns Checksum
+ */
+uint64_t transitionGraphImageChecksum(const char* image, size_t size) {
+    TransitionGraphImageHeader header;
+    memcpy(&header, image, sizeof(header));
+    header.checksum = 0;
+    header.imageChecksum = 0;
+
+    uint64_t hash = 14695981039346656037ULL;
+    const unsigned char* bytes = (const unsigned char*) &header;
+    for(size_t i=0;i<sizeof(header);++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    for(size_t i=sizeof(header);i<size;++i) {
+        hash = (hash ^ (unsigned char) image[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*
+ * Helper function for saveTransitionGraphImage
+ * Lists the arrays of the graph with their sizes in bytes (NULL for missing arrays).
+ */
+static void transitionGraphImageArrays(const TransitionGraph tg, const void** data, uint64_t* length) {
+    const uint64_t rows = (uint64_t) tg->Q * tg->C;
+    const uint64_t set_bytes = (uint64_t) tg->setWords * sizeof(uint64_t);
+
+    data[TG_IMAGE_ROW_OFFSET] = tg->rowOffset;
+    length[TG_IMAGE_ROW_OFFSET] = (rows + 1) * sizeof(int);
+    data[TG_IMAGE_EDGES] = tg->edges;
+    length[TG_IMAGE_EDGES] = (uint64_t) tg->edgeCount * sizeof(int);
+    data[TG_IMAGE_DENSE_ROW] = tg->denseRow;
+    length[TG_IMAGE_DENSE_ROW] = rows * sizeof(int);
+    data[TG_IMAGE_DENSE_MASKS] = tg->denseMasks;
+    length[TG_IMAGE_DENSE_MASKS] = (uint64_t) tg->denseCount * set_bytes;
+    data[TG_IMAGE_ACCEPTING_STATES] = tg->acceptingStates;
+    length[TG_IMAGE_ACCEPTING_STATES] = (uint64_t) tg->Q;
+    data[TG_IMAGE_ACCEPTING_MASK] = tg->acceptingMask;
+    length[TG_IMAGE_ACCEPTING_MASK] = set_bytes;
+    data[TG_IMAGE_MIN_ACCEPT] = tg->minAccept;
+    data[TG_IMAGE_MAX_ACCEPT] = tg->maxAccept;
+    data[TG_IMAGE_MIN_REJECT] = tg->minReject;
+    data[TG_IMAGE_MAX_REJECT] = tg->maxReject;
+    for(int i=TG_IMAGE_MIN_ACCEPT;i<=TG_IMAGE_MAX_REJECT;++i) {
+        length[i] = (uint64_t) tg->Q * sizeof(int);
+    }
+    data[TG_IMAGE_STEP_TABLES] = tg->stepTables;
+    length[TG_IMAGE_STEP_TABLES] = (uint64_t) tg->C * tg->stepChunks * 256 * tg->stepStride * sizeof(uint64_t);
+    data[TG_IMAGE_STEP_MASKS] = tg->stepMasks;
+    length[TG_IMAGE_STEP_MASKS] = 2 * (uint64_t) tg->stepStride * sizeof(uint64_t);
+
+    for(int i=0;i<TG_IMAGE_ARRAY_COUNT;++i) {
+        if(data[i] == NULL) {
+            length[i] = 0;
+        }
+    }
+}
+
+/**
+ * Writes the image of the loaded transition graph.
+ *
+ * @param[in]  tg   : Transition graph
+ * @param[out] size : Pointer to the variable receiving the size of the image in bytes
+ * @returns Allocated image
+ */
+char* saveTransitionGraphImage(const TransitionGraph tg, size_t* size) {
+    const void* data[TG_IMAGE_ARRAY_COUNT];
+    uint64_t length[TG_IMAGE_ARRAY_COUNT];
+    transitionGraphImageArrays(tg, data, length);
+
+    TransitionGraphImageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = TRANSITION_GRAPH_IMAGE_MAGIC;
+    header.version = TRANSITION_GRAPH_IMAGE_VERSION;
+    header.headerSize = sizeof(header);
+    header.checksum = transitionGraphChecksum(tg);
+    header.A = tg->A;
+    header.C = tg->C;
+    header.Q = tg->Q;
+    header.U = tg->U;
+    header.F = tg->F;
+    header.q0 = tg->q0;
+    header.setWords = tg->setWords;
+    header.edgeCount = tg->edgeCount;
+    header.denseCount = tg->denseCount;
+    header.stepChunks = (tg->stepTables != NULL) ? tg->stepChunks : 0;
+    header.stepStride = (tg->stepTables != NULL) ? tg->stepStride : 0;
+    for(int a=0;a<256;++a) {
+        header.letterClass[a] = tg->letterClass[a];
+    }
+
+    uint64_t position = sizeof(header);
+    for(int i=0;i<TG_IMAGE_ARRAY_COUNT;++i) {
+        if(data[i] == NULL) {
+            continue;
+        }
+        position = (position + TRANSITION_GRAPH_IMAGE_ALIGN - 1) / TRANSITION_GRAPH_IMAGE_ALIGN * TRANSITION_GRAPH_IMAGE_ALIGN;
+        header.offset[i] = position;
+        header.length[i] = length[i];
+        position += length[i];
+    }
+    header.size = position;
+
+    char* image = MALLOCATE_ARRAY(char, position);
+    for(int i=0;i<TG_IMAGE_ARRAY_COUNT;++i) {
+        if(data[i] != NULL && length[i] > 0) {
+            memcpy(image + header.offset[i], data[i], length[i]);
+        }
+    }
+    memcpy(image, &header, sizeof(header));
+    header.imageChecksum = transitionGraphImageChecksum(image, position);
+    memcpy(image, &header, sizeof(header));
+
+    *size = (size_t) position;
+    return image;
+}
+
+/**
+ * Opens the transition graph stored in the image.
+ *
+ * The graph points directly into the image, which must stay valid (and must not be modified)
+ * as long as the graph is used. Only the structure of the graph is allocated, so
+ * opening the graph costs the same for all the automata.
+ * The graph must not be modified (e.g. minimized). It's freed as usual by freeTransitionGraph
+ * (the image itself is not freed).
+ *
+ * @param[in] image : Image written by saveTransitionGraphImage
+ * @param[in] size  : Size of the image in bytes
+ * @returns Transition graph or NULL if the image is invalid
+ */
+TransitionGraph openTransitionGraphImage(const char* image, size_t size) {
+    const TransitionGraphImageHeader* header = (const TransitionGraphImageHeader*) image;
+    if(size < sizeof(TransitionGraphImageHeader) || header->magic != TRANSITION_GRAPH_IMAGE_MAGIC
+        || header->version != TRANSITION_GRAPH_IMAGE_VERSION || header->headerSize != sizeof(TransitionGraphImageHeader)
+        || header->size > size) {
+        log_err(AUTOMATON, "Invalid transition graph image (%llu bytes)", (unsigned long long) size);
+        return NULL;
+    }
+    for(int i=0;i<TG_IMAGE_ARRAY_COUNT;++i) {
+        if(header->offset[i] % TRANSITION_GRAPH_IMAGE_ALIGN != 0 || header->offset[i] + header->length[i] > header->size) {
+            log_err(AUTOMATON, "Invalid transition graph image (array %d out of bounds)", i);
+            return NULL;
+        }
+    }
+
+    TransitionGraph tg = newTransitionGraph();
+    tg->image = image;
+    tg->A = header->A;
+    tg->C = header->C;
+    tg->Q = header->Q;
+    tg->U = header->U;
+    tg->F = header->F;
+    tg->q0 = header->q0;
+    tg->setWords = header->setWords;
+    tg->edgeCount = header->edgeCount;
+    tg->denseCount = header->denseCount;
+    for(int a=0;a<256;++a) {
+        tg->letterClass[a] = header->letterClass[a];
+    }
+
+    void* arrays[TG_IMAGE_ARRAY_COUNT];
+    for(int i=0;i<TG_IMAGE_ARRAY_COUNT;++i) {
+        arrays[i] = (header->offset[i] != 0) ? (void*) (image + header->offset[i]) : NULL;
+    }
+    tg->rowOffset = (int*) arrays[TG_IMAGE_ROW_OFFSET];
+    tg->edges = (int*) arrays[TG_IMAGE_EDGES];
+    tg->denseRow = (int*) arrays[TG_IMAGE_DENSE_ROW];
+    tg->denseMasks = (uint64_t*) arrays[TG_IMAGE_DENSE_MASKS];
+    tg->acceptingStates = (char*) arrays[TG_IMAGE_ACCEPTING_STATES];
+    tg->acceptingMask = (uint64_t*) arrays[TG_IMAGE_ACCEPTING_MASK];
+    tg->minAccept = (int*) arrays[TG_IMAGE_MIN_ACCEPT];
+    tg->maxAccept = (int*) arrays[TG_IMAGE_MAX_ACCEPT];
+    tg->minReject = (int*) arrays[TG_IMAGE_MIN_REJECT];
+    tg->maxReject = (int*) arrays[TG_IMAGE_MAX_REJECT];
+    tg->stepTables = (uint64_t*) arrays[TG_IMAGE_STEP_TABLES];
+    tg->stepMasks = (uint64_t*) arrays[TG_IMAGE_STEP_MASKS];
+
+    // The arrays must match the header
+    const void* data[TG_IMAGE_ARRAY_COUNT];
+    uint64_t expected[TG_IMAGE_ARRAY_COUNT];
+    tg->stepChunks = header->stepChunks;
+    tg->stepStride = header->stepStride;
+    transitionGraphImageArrays(tg, data, expected);
+    const int required[] = { TG_IMAGE_ROW_OFFSET, TG_IMAGE_DENSE_ROW, TG_IMAGE_ACCEPTING_STATES, TG_IMAGE_ACCEPTING_MASK };
+    int valid = (tg->Q > 0 && tg->C >= 0 && tg->setWords >= stateSetWords(tg->Q) && tg->q0 >= 0 && tg->q0 < tg->Q);
+    for(int i=0;i<(int) (sizeof(required) / sizeof(required[0]));++i) {
+        valid = valid && (data[required[i]] != NULL);
+    }
+    for(int i=0;i<TG_IMAGE_ARRAY_COUNT;++i) {
+        valid = valid && (data[i] == NULL || header->length[i] == expected[i]);
+    }
+    if(!valid) {
+        log_err(AUTOMATON, "Invalid transition graph image (arrays do not match the header)");
+        FREE(tg);
+        return NULL;
+    }
+
+    // The kernel is chosen by this process (its stride must match the stored tables)
+    if(tg->stepTables != NULL) {
+        tg->stepKernel = selectStepKernel(tg->setWords, STEP_KERNEL_MAX_LANES);
+        if(tg->stepStride % tg->stepKernel->lanes != 0) {
+            tg->stepKernel = selectStepKernel(1, 1);
+        }
+    }
+    selectTransitionGraphVariant(tg);
+    transitionGraphStatistics(tg);
+
+    return tg;
+}
+
+/*
+ * Helper function for shareTransitionGraphImage
+ * Writes the whole buffer to the file descriptor.
+ */
+static int transitionGraphImageWriteAll(int fd, const char* data, size_t size) {
+    while(size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if(written < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        data += written;
+        size -= (size_t) written;
+    }
+    return 1;
+}
+
+/**
+ * Writes the image of the transition graph into a new POSIX shared memory object.
+ * The stale object with the same name (left by a crashed server) is replaced.
+ *
+ * @param[in] tg   : Transition graph
+ * @param[in] name : Name of the shared memory object (like "/FinAutomGraph")
+ * @returns If the image was shared?
+ */
+int shareTransitionGraphImage(const TransitionGraph tg, const char* name) {
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd == -1 && errno == EEXIST) {
+        shm_unlink(name);
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if(fd == -1) {
+        log_warn(AUTOMATON, "Failed to create shared graph image %s", name);
+        return 0;
+    }
+
+    size_t size;
+    char* image = saveTransitionGraphImage(tg, &size);
+    const int status = transitionGraphImageWriteAll(fd, image, size);
+    FREE(image);
+    close(fd);
+
+    if(!status) {
+        log_warn(AUTOMATON, "Failed to write shared graph image %s", name);
+        shm_unlink(name);
+        return 0;
+    }
+    log(AUTOMATON, "Shared graph image %s: %llu bytes", name, (unsigned long long) size);
+    return 1;
+}
+
+/**
+ * Removes the shared memory object created by shareTransitionGraphImage.
+ * The processes that have already mapped the image can still use it.
+ *
+ * @param[in] name : Name of the shared memory object
+ */
+void removeTransitionGraphImage(const char* name) {
+    shm_unlink(name);
+}
+
+/**
+ * Maps the image from the file descriptor read-only and opens the graph stored in it.
+ * The descriptor can be closed afterwards.
+ *
+ * @param[in] fd : File descriptor (regular file or shared memory object)
+ * @returns Transition graph (free it with unmapTransitionGraphImage) or NULL on failure
+ */
+TransitionGraph mapTransitionGraphImageFd(int fd) {
+    struct stat st;
+    if(fstat(fd, &st) == -1 || st.st_size <= 0) {
+        log_err(AUTOMATON, "Failed to stat the graph image");
+        return NULL;
+    }
+
+    const size_t size = (size_t) st.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if(mapping == MAP_FAILED) {
+        log_err(AUTOMATON, "Failed to map the graph image (%llu bytes)", (unsigned long long) size);
+        return NULL;
+    }
+
+    TransitionGraph tg = openTransitionGraphImage((const char*) mapping, size);
+    if(tg == NULL) {
+        munmap(mapping, size);
+        return NULL;
+    }
+    tg->imageSize = size;
+    return tg;
+}
+
+/**
+ * Maps read-only the image shared by shareTransitionGraphImage.
+ *
+ * @param[in] name : Name of the shared memory object
+ * @returns Transition graph (free it with unmapTransitionGraphImage) or NULL on failure
+ */
+TransitionGraph mapTransitionGraphImage(const char* name) {
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if(fd == -1) {
+        log_err(AUTOMATON, "Failed to open shared graph image %s", name);
+        return NULL;
+    }
+    TransitionGraph tg = mapTransitionGraphImageFd(fd);
+    close(fd);
+    return tg;
+}
+
+/**
+ * Frees the graph mapped by mapTransitionGraphImage (or mapTransitionGraphImageFd) and unmaps its image.
+ *
+ * @param[in] tg : Transition graph
+ */
+void unmapTransitionGraphImage(TransitionGraph tg) {
+    void* mapping = (void*) tg->image;
+    const size_t size = tg->imageSize;
+    freeTransitionGraph(tg);
+    if(mapping != NULL && size > 0) {
+        munmap(mapping, size);
+    }
+}
+
+/**
+ * Writes the image of the transition graph into the .autb file.
+ *
+ * @param[in] tg   : Transition graph
+ * @param[in] path : Path of the output file
+ * @returns If the file was written?
+ */
+int saveTransitionGraphImageFile(const TransitionGraph tg, const char* path) {
+    FILE* out = fopen(path, "wb");
+    if(out == NULL) {
+        log_err(AUTOMATON, "Failed to open %s for writing", path);
+        return 0;
+    }
+
+    size_t size;
+    char* image = saveTransitionGraphImage(tg, &size);
+    int status = (fwrite(image, 1, size, out) == size);
+    FREE(image);
+    status = (fclose(out) == 0) && status;
+
+    if(!status) {
+        log_err(AUTOMATON, "Failed to write the graph image %s", path);
+        return 0;
+    }
+    log(AUTOMATON, "Written graph image %s: %llu bytes", path, (unsigned long long) size);
+    return 1;
+}
+
+/*
+ * Helper function for loadTransitionGraphImageFile
+ * Checks that all the indices stored in the graph opened from the image are in range,
+ * so that the engines never read outside the arrays (O(Q*C + E)):
+ * rowOffset is monotone from 0 to edgeCount, the edges are states, the dense rows
+ * point into denseMasks and the letter classes are below C.
+ */
+static int validateTransitionGraphImage(const TransitionGraph tg) {
+    if(tg->U < 0 || tg->U > tg->Q || tg->F < 0 || tg->F > tg->Q || tg->A < 0 || tg->A > 256 || tg->edgeCount < 0 || tg->denseCount < 0) {
+        return 0;
+    }
+    for(int a=0;a<256;++a) {
+        if(tg->letterClass[a] < -1 || tg->letterClass[a] >= tg->C) {
+            return 0;
+        }
+    }
+    const int rows = tg->Q * tg->C;
+    if(tg->rowOffset[0] != 0 || tg->rowOffset[rows] != tg->edgeCount) {
+        return 0;
+    }
+    for(int r=0;r<rows;++r) {
+        if(tg->rowOffset[r] > tg->rowOffset[r + 1]) {
+            return 0;
+        }
+        if(tg->denseRow[r] < -1 || tg->denseRow[r] >= tg->denseCount) {
+            return 0;
+        }
+    }
+    for(int i=0;i<tg->edgeCount;++i) {
+        if(tg->edges[i] < 0 || tg->edges[i] >= tg->Q) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Loads the transition graph from the .autb file written by saveTransitionGraphImageFile.
+ * The file is mapped read-only, nothing is parsed. The checksum of the image is verified
+ * and all the stored indices are checked to be in range (see validateTransitionGraphImage),
+ * so damaged files are rejected.
+ *
+ * @param[in] path : Path of the file
+ * @returns Transition graph (free it with unmapTransitionGraphImage) or NULL on failure
+ */
+TransitionGraph loadTransitionGraphImageFile(const char* path) {
+    const int fd = open(path, O_RDONLY);
+    if(fd == -1) {
+        log_err(AUTOMATON, "Failed to open the graph image %s", path);
+        return NULL;
+    }
+    TransitionGraph tg = mapTransitionGraphImageFd(fd);
+    close(fd);
+    if(tg == NULL) {
+        return NULL;
+    }
+
+    const TransitionGraphImageHeader* header = (const TransitionGraphImageHeader*) tg->image;
+    if(transitionGraphImageChecksum(tg->image, header->size) != header->imageChecksum) {
+        log_err(AUTOMATON, "Graph image %s is damaged (checksum mismatch)", path);
+        unmapTransitionGraphImage(tg);
+        return NULL;
+    }
+    if(!validateTransitionGraphImage(tg)) {
+        log_err(AUTOMATON, "Graph image %s is damaged (transitions out of range)", path);
+        unmapTransitionGraphImage(tg);
+        return NULL;
+    }
+    log(AUTOMATON, "Mapped graph image %s: %d states, %d edges", path, tg->Q, tg->edgeCount);
+    return tg;
+}
+
+#endif // __AUTOMATON_IMAGE_H__
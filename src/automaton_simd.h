@@ -0,0 +1,212 @@
+/** @file
+*
+*  Vectorized kernels of the backward step on sets of states (C99 standard)
+*
+*  The backward step (see stateSetStepBack in automaton.h) asks for each state q if the successors T(q,c)
+*  are contained in (universal q) or overlap (existential q) the given set S.
+*  Transposed, it's enough to know the union of the predecessors of the states in S (the states
+*  with a successor in S) and the union of the predecessors of the states outside S (the states
+*  with a successor outside S).
+*
+*  Both unions are read from the step tables built for each letter class: the states are split
+*  into chunks of 8 and for each chunk and each of 256 subsets of the chunk the table keeps the union
+*  of the predecessors of the subset. So the step is 2 * ceil(Q/8) table lookups and ORs of whole sets
+*  (for Q of about 100 and sets fitting single vector register - a few dozen vector instructions).
+*
+*  The kernels differ only in the width of the OR: 64-bit words (scalar fallback), SSE2 (2 words),
+*  AVX2 (4 words) and AVX-512 (8 words). The widest kernel supported by the processor (checked through CPUID)
+*  and not wider than the set is selected when the tables are built (or even wider one if the rows
+*  are padded to its width anyway), so the sets of Q of about 100 states (2 words) use SSE2.
+*
+*  @author Piotr Styczyński <piotrsty1@gmail.com>
+*  @copyright MIT
+*  @date 2018-01-21
+*/
+#ifndef __AUTOMATON_SIMD_H__
+#define __AUTOMATON_SIMD_H__
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define STEP_KERNELS_X86 1
+#include <immintrin.h>
+#else
+#define STEP_KERNELS_X86 0
+#endif
+
+/**
+ * Type of the step kernel
+ *
+ * The kernel ORs the step table rows selected by the bytes of the set @p next:
+ *   * @p in receives the union of rows selected by the bytes of @p next
+ *   * @p out receives the union of rows selected by the complements of the bytes of @p next
+ *
+ * The table has @p chunks * 256 rows of @p stride words (stride is multiple of the kernel lanes).
+ */
+typedef void (*StepKernel)(const uint64_t* table, int chunks, int stride, const uint64_t* next, uint64_t* in, uint64_t* out);
+
+/**
+ * Structure to describe the step kernel
+ */
+typedef struct StepKernelInfo {
+    const char* name;  ///< name of the kernel (for logging)
+    int lanes;         ///< number of 64-bit words processed at once
+    StepKernel kernel; ///< the kernel function
+} StepKernelInfo;
+
+/*
+ * Helper function for step kernels
+ * Returns the k-th byte of the set (bits 8k..8k+7)
+ */
+static inline unsigned int stepKernelByte(const uint64_t* set, int k) {
+    return (unsigned int) (set[k >> 3] >> ((k & 7) * 8)) & 0xFF;
+}
+
+/*
+ * Scalar step kernel (64-bit words)
+ */
+static inline void stepKernelScalar(const uint64_t* table, int chunks, int stride, const uint64_t* next, uint64_t* in, uint64_t* out) {
+    for(int w=0;w<stride;++w) {
+        in[w] = 0;
+        out[w] = 0;
+    }
+    for(int k=0;k<chunks;++k) {
+        const unsigned int b = stepKernelByte(next, k);
+        const uint64_t* rowIn = &table[((size_t) k * 256 + b) * stride];
+        const uint64_t* rowOut = &table[((size_t) k * 256 + (~b & 0xFF)) * stride];
+        for(int w=0;w<stride;++w) {
+            in[w] |= rowIn[w];
+            out[w] |= rowOut[w];
+        }
+    }
+}
+
+#if STEP_KERNELS_X86 == 1
+
+/*
+ * SSE2 step kernel (2 words per instruction)
+ */
+__attribute__((target("sse2")))
+static inline void stepKernelSSE2(const uint64_t* table, int chunks, int stride, const uint64_t* next, uint64_t* in, uint64_t* out) {
+    for(int w=0;w<stride;w+=2) {
+        __m128i accIn = _mm_setzero_si128();
+        __m128i accOut = _mm_setzero_si128();
+        for(int k=0;k<chunks;++k) {
+            const unsigned int b = stepKernelByte(next, k);
+            accIn = _mm_or_si128(accIn, _mm_loadu_si128((const __m128i*) &table[((size_t) k * 256 + b) * stride + w]));
+            accOut = _mm_or_si128(accOut, _mm_loadu_si128((const __m128i*) &table[((size_t) k * 256 + (~b & 0xFF)) * stride + w]));
+        }
+        _mm_storeu_si128((__m128i*) &in[w], accIn);
+        _mm_storeu_si128((__m128i*) &out[w], accOut);
+    }
+}
+
+/*
+ * AVX2 step kernel (4 words per instruction)
+ */
+__attribute__((target("avx2")))
+static inline void stepKernelAVX2(const uint64_t* table, int chunks, int stride, const uint64_t* next, uint64_t* in, uint64_t* out) {
+    for(int w=0;w<stride;w+=4) {
+        __m256i accIn = _mm256_setzero_si256();
+        __m256i accOut = _mm256_setzero_si256();
+        for(int k=0;k<chunks;++k) {
+            const unsigned int b = stepKernelByte(next, k);
+            accIn = _mm256_or_si256(accIn, _mm256_loadu_si256((const __m256i*) &table[((size_t) k * 256 + b) * stride + w]));
+            accOut = _mm256_or_si256(accOut, _mm256_loadu_si256((const __m256i*) &table[((size_t) k * 256 + (~b & 0xFF)) * stride + w]));
+        }
+        _mm256_storeu_si256((__m256i*) &in[w], accIn);
+        _mm256_storeu_si256((__m256i*) &out[w], accOut);
+    }
+}
+
+/*
+ * AVX-512 step kernel (8 words per instruction)
+ */
+__attribute__((target("avx512f")))
+static inline void stepKernelAVX512(const uint64_t* table, int chunks, int stride, const uint64_t* next, uint64_t* in, uint64_t* out) {
+    for(int w=0;w<stride;w+=8) {
+        __m512i accIn = _mm512_setzero_si512();
+        __m512i accOut = _mm512_setzero_si512();
+        for(int k=0;k<chunks;++k) {
+            const unsigned int b = stepKernelByte(next, k);
+            accIn = _mm512_or_si512(accIn, _mm512_loadu_si512((const void*) &table[((size_t) k * 256 + b) * stride + w]));
+            accOut = _mm512_or_si512(accOut, _mm512_loadu_si512((const void*) &table[((size_t) k * 256 + (~b & 0xFF)) * stride + w]));
+        }
+        _mm512_storeu_si512((void*) &in[w], accIn);
+        _mm512_storeu_si512((void*) &out[w], accOut);
+    }
+}
+
+#endif
+
+/**
+ * Step kernels from the widest one
+ */
+static const StepKernelInfo stepKernels[] = {
+#if STEP_KERNELS_X86 == 1
+    { "avx512", 8, stepKernelAVX512 },
+    { "avx2",   4, stepKernelAVX2 },
+    { "sse2",   2, stepKernelSSE2 },
+#endif
+    { "scalar", 1, stepKernelScalar }
+};
+
+/*
+ * Helper function for selectStepKernel
+ * Checks if the processor supports the kernel (through CPUID)
+ */
+static int stepKernelSupported(const StepKernelInfo* info) {
+#if STEP_KERNELS_X86 == 1
+    static int detected = 0;
+    static int hasSSE2 = 0;
+    static int hasAVX2 = 0;
+    static int hasAVX512 = 0;
+    if(!detected) {
+        __builtin_cpu_init();
+        hasSSE2 = __builtin_cpu_supports("sse2");
+        hasAVX2 = __builtin_cpu_supports("avx2");
+        hasAVX512 = __builtin_cpu_supports("avx512f");
+        detected = 1;
+    }
+    if(info->kernel == stepKernelAVX512) {
+        return hasAVX512;
+    }
+    if(info->kernel == stepKernelAVX2) {
+        return hasAVX2;
+    }
+    if(info->kernel == stepKernelSSE2) {
+        return hasSSE2;
+    }
+#endif
+    (void) info;
+    return 1;
+}
+
+/**
+ * Selects the widest step kernel supported by the processor that is not wider than the set.
+ * The rows are padded to the width of that kernel, so if a wider kernel needs no more padding
+ * (e.g. AVX2 for sets of 3 words) the wider one is selected.
+ *
+ * @param[in] words   : Number of 64-bit words in the set
+ * @param[in] maxLanes: Maximum allowed width of the kernel (in words, use 8 for no limit)
+ * @returns Description of the selected kernel
+ */
+const StepKernelInfo* selectStepKernel(int words, int maxLanes) {
+    const int count = sizeof(stepKernels) / sizeof(stepKernels[0]);
+    const StepKernelInfo* selected = &stepKernels[count - 1];
+    for(int i=0;i<count;++i) {
+        if(stepKernels[i].lanes <= words && stepKernels[i].lanes <= maxLanes && stepKernelSupported(&stepKernels[i])) {
+            selected = &stepKernels[i];
+            break;
+        }
+    }
+    const int stride = (words + selected->lanes - 1) / selected->lanes * selected->lanes;
+    for(int i=0;i<count;++i) {
+        if(stepKernels[i].lanes <= stride && stride % stepKernels[i].lanes == 0 && stepKernels[i].lanes <= maxLanes && stepKernelSupported(&stepKernels[i])) {
+            return &stepKernels[i];
+        }
+    }
+    return selected;
+}
+
+#endif // __AUTOMATON_SIMD_H__
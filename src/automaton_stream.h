@@ -0,0 +1,353 @@
+/** @file
+*
+*  Streaming (forward) accept (C99 standard)
+*
+*  The word is consumed letter by letter in chunks of any size and the verdict
+*  for the part received so far can be asked for at any time.
+*
+*  After reading the prefix w the stream keeps the positive boolean formula over the states
+*  telling which states must accept the rest of the word, so that the whole word is accepted.
+*  The formula is kept in disjunctive normal form: the set of clauses, each clause is a set of states
+*  that must all accept the rest. The initial formula is the single clause {q0}.
+*
+*  Reading letter a replaces each state q of each clause with T(q,a):
+*    * universal q with conjunction of T(q,a) (true if T(q,a) is empty)
+*    * existential q with disjunction of T(q,a) (false if T(q,a) is empty)
+*  and the result is expanded back to DNF. Clauses being supersets of other clauses are removed,
+*  so the formula is always the minimal set of clauses (an antichain).
+*
+*  The verdict for the current prefix is positive iff some clause contains only accepting states.
+*
+*  The number of clauses is limited by ACCEPT_STREAM_CLAUSE_LIMIT (an antichain of the sets of states
+*  can be exponential in the number of states). When it would be exceeded the formula is frozen
+*  and further letters are buffered. Then the verdict evaluates the buffered suffix backwards
+*  (see stateSetStepBack) and tests the frozen formula on the result, so the answers are always exact,
+*  but each verdict costs a step per buffered letter.
+*
+*  The buffer is limited by ACCEPT_STREAM_PENDING_LIMIT letters, so the stream never takes more than
+*  ACCEPT_STREAM_CLAUSE_LIMIT clauses and ACCEPT_STREAM_PENDING_LIMIT letters of memory.
+*  When the buffer is full the feed fails and the stream is no longer usable
+*  (the caller must evaluate the word otherwise).
+*
+*  The work done by acceptStreamFeed (expanded states and compared clauses) can be bounded
+*  with acceptStreamSetWorkLimit. When the limit is exceeded the feed fails in the same way.
+*
+*  @author Piotr Styczyński <piotrsty1@gmail.com>
+*  @copyright MIT
+*  @date 2018-01-21
+*/
+#ifndef __AUTOMATON_STREAM_H__
+#define __AUTOMATON_STREAM_H__
+
+#include <string.h>
+#include <stdint.h>
+#include "automaton.h"
+#include "memalloc.h"
+#include "syslog.h"
+
+typedef struct AcceptStreamImpl AcceptStreamImpl;
+
+/**
+ * Type of the streaming evaluator (pointer to the actual data structure)
+ */
+typedef AcceptStreamImpl* AcceptStream;
+
+/**
+ * Structure to hold the state of the streaming evaluator
+ *
+ * The clauses are stored one after another (setWords words per clause).
+ * Two buffers are used alternately by acceptStreamFeed. Each buffer has its own capacity,
+ * so only the formula being built is reallocated while the clauses of the current one are expanded.
+ */
+struct AcceptStreamImpl {
+    TransitionGraph tg;  ///< transition graph of the automaton
+    uint64_t* clauses;   ///< clauses of the current formula
+    int clauseCount;     ///< number of the clauses
+    uint64_t* next;      ///< clauses of the formula being built
+    int nextCount;       ///< number of the clauses being built
+    int capacity;        ///< capacity of the current clause buffer (in clauses)
+    int nextCapacity;    ///< capacity of the clause buffer being built (in clauses)
+    char* pending;       ///< letters received after the formula was frozen (NULL if it's not frozen)
+    int pendingLength;   ///< number of the buffered letters
+    int pendingCapacity; ///< size of the pending buffer
+    long long length;    ///< number of the letters received so far
+    long long work;      ///< work done by acceptStreamFeed since the limit was set
+    long long workLimit; ///< limit of the work (0 if there's no limit)
+    int exhausted;       ///< if the work limit or the pending limit was exceeded (the stream is no longer valid)
+};
+
+/**
+ * Removes all the received letters, so the stream is ready for the new word.
+ *
+ * @param[in] st : Streaming evaluator
+ */
+void acceptStreamReset(AcceptStream st) {
+    const int words = st->tg->setWords;
+    stateSetClear(st->clauses, words);
+    stateSetAdd(st->clauses, st->tg->q0);
+    st->clauseCount = 1;
+    st->nextCount = 0;
+    FREE(st->pending);
+    st->pending = NULL;
+    st->pendingLength = 0;
+    st->pendingCapacity = 0;
+    st->length = 0;
+    st->exhausted = 0;
+}
+
+/**
+ * Bounds the work done by the following calls of acceptStreamFeed.
+ * The work is counted in expanded states and compared clauses (roughly the run tree nodes).
+ * When the limit is exceeded acceptStreamFeed returns 0 and the stream must be reset or freed.
+ * With the limit set the formula is never frozen (exceeding ACCEPT_STREAM_CLAUSE_LIMIT exceeds the limit as well).
+ *
+ * @param[in] st    : Streaming evaluator
+ * @param[in] limit : Limit of the work (0 for no limit)
+ */
+void acceptStreamSetWorkLimit(AcceptStream st, long long limit) {
+    st->work = 0;
+    st->workLimit = limit;
+}
+
+/**
+ * Creates new streaming evaluator for the given transition graph.
+ * The graph must be already loaded and must not be modified while the stream is used.
+ *
+ * @param[in] tg : Transition graph
+ * @returns New streaming evaluator (with empty word received)
+ */
+AcceptStream newAcceptStream(TransitionGraph tg) {
+    AcceptStream st = MALLOCATE(AcceptStreamImpl);
+    st->tg = tg;
+    st->capacity = 16;
+    st->nextCapacity = 16;
+    st->clauses = MALLOCATE_ARRAY(uint64_t, st->capacity * tg->setWords);
+    st->next = MALLOCATE_ARRAY(uint64_t, st->nextCapacity * tg->setWords);
+    st->pending = NULL;
+    st->work = 0;
+    st->workLimit = 0;
+    acceptStreamReset(st);
+    return st;
+}
+
+/**
+ * Frees the streaming evaluator.
+ *
+ * @param[in] st : Streaming evaluator
+ */
+void freeAcceptStream(AcceptStream st) {
+    FREE(st->clauses);
+    FREE(st->next);
+    FREE(st->pending);
+    FREE(st);
+}
+
+/*
+ * Helper function for AcceptStream
+ * Checks if the clause a is subset of the clause b.
+ */
+static inline int acceptStreamSubset(const uint64_t* a, const uint64_t* b, int words) {
+    for(int w=0;w<words;++w) {
+        if(a[w] & ~b[w]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Helper function for AcceptStream
+ * Adds the clause to the formula being built, keeping it minimal.
+ * Returns 0 if ACCEPT_STREAM_CLAUSE_LIMIT or the work limit would be exceeded.
+ */
+static int acceptStreamAddClause(AcceptStream st, const uint64_t* clause) {
+    const int words = st->tg->setWords;
+    st->work += st->nextCount;
+    if(st->workLimit > 0 && st->work > st->workLimit) {
+        st->exhausted = 1;
+        return 0;
+    }
+    int kept = 0;
+    for(int i=0;i<st->nextCount;++i) {
+        uint64_t* other = &(st->next[i * words]);
+        if(acceptStreamSubset(other, clause, words)) {
+            // The clause is implied by already present one
+            return 1;
+        }
+        if(!acceptStreamSubset(clause, other, words)) {
+            if(kept != i) {
+                stateSetCopy(&(st->next[kept * words]), other, words);
+            }
+            ++kept;
+        }
+    }
+    st->nextCount = kept;
+
+    if(st->nextCount >= ACCEPT_STREAM_CLAUSE_LIMIT) {
+        return 0;
+    }
+    if(st->nextCount >= st->nextCapacity) {
+        // Only the formula being built is grown (the current clauses are still being expanded)
+        st->nextCapacity *= 2;
+        st->next = MREALLOCATE_ARRAY(uint64_t, st->nextCapacity * words, st->next);
+    }
+    stateSetCopy(&(st->next[(st->nextCount++) * words]), clause, words);
+    return 1;
+}
+
+/*
+ * Helper function for AcceptStream
+ * Adds to the formula being built the expansion of the clause by the letter class c.
+ * The universal states of the clause are replaced at once by all their successors
+ * and existential states are expanded recursively (from the state q on), so the
+ * partial clause is the conjunction chosen so far.
+ * Returns 0 if ACCEPT_STREAM_CLAUSE_LIMIT or the work limit would be exceeded.
+ */
+static int acceptStreamExpand(AcceptStream st, const uint64_t* clause, int c, int q, uint64_t* partial) {
+    const TransitionGraph tg = st->tg;
+    if(st->workLimit > 0 && ++(st->work) > st->workLimit) {
+        st->exhausted = 1;
+        return 0;
+    }
+
+    // Find the next existential state of the clause
+    while(q < tg->Q && !(q >= tg->U && stateSetHas(clause, q))) {
+        ++q;
+    }
+    if(q >= tg->Q) {
+        return acceptStreamAddClause(st, partial);
+    }
+
+    const int count = transitionCount(tg, q, c);
+    const int* targets = transitionTargets(tg, q, c);
+    for(int i=0;i<count;++i) {
+        if(stateSetHas(partial, targets[i])) {
+            // This choice adds nothing, so it implies all the other ones
+            return acceptStreamExpand(st, clause, c, q + 1, partial);
+        }
+    }
+    for(int i=0;i<count;++i) {
+        stateSetAdd(partial, targets[i]);
+        const int status = acceptStreamExpand(st, clause, c, q + 1, partial);
+        partial[targets[i] / 64] &= ~(((uint64_t) 1) << (targets[i] % 64));
+        if(!status) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Feeds the next chunk of the word to the stream.
+ *
+ * @param[in] st        : Streaming evaluator
+ * @param[in] chunk     : Letters of the word
+ * @param[in] chunk_len : Number of the letters in the chunk
+ * @returns 0 if the work limit (see acceptStreamSetWorkLimit) or ACCEPT_STREAM_PENDING_LIMIT was exceeded, 1 otherwise
+ */
+int acceptStreamFeed(AcceptStream st, const char* chunk, int chunk_len) {
+    const TransitionGraph tg = st->tg;
+    const int words = tg->setWords;
+    uint64_t partial[words];
+
+    for(int i=0;i<chunk_len;++i) {
+        if(st->exhausted) {
+            return 0;
+        }
+        if(st->pending != NULL && st->pendingLength >= ACCEPT_STREAM_PENDING_LIMIT) {
+            log_warn(AUTOMATON, "Stream buffers more than %d letters - the word must be evaluated otherwise.", ACCEPT_STREAM_PENDING_LIMIT);
+            st->exhausted = 1;
+            return 0;
+        }
+        ++(st->length);
+
+        if(st->pending != NULL) {
+            if(st->pendingLength >= st->pendingCapacity) {
+                st->pendingCapacity = (st->pendingCapacity > ACCEPT_STREAM_PENDING_LIMIT / 2) ? ACCEPT_STREAM_PENDING_LIMIT : 2 * st->pendingCapacity;
+                st->pending = MREALLOCATE_ARRAY(char, st->pendingCapacity, st->pending);
+            }
+            st->pending[st->pendingLength++] = chunk[i];
+            continue;
+        }
+
+        const int c = letterClassOf(tg, chunk[i]);
+        int status = 1;
+        st->nextCount = 0;
+        for(int k=0;k<st->clauseCount && status;++k) {
+            const uint64_t* clause = &(st->clauses[k * words]);
+
+            // Universal states: all the successors are required (none if there are no successors)
+            stateSetClear(partial, words);
+            for(int q=0;q<tg->U;++q) {
+                if(stateSetHas(clause, q)) {
+                    const int count = transitionCount(tg, q, c);
+                    const int* targets = transitionTargets(tg, q, c);
+                    for(int j=0;j<count;++j) {
+                        stateSetAdd(partial, targets[j]);
+                    }
+                }
+            }
+            status = acceptStreamExpand(st, clause, c, tg->U, partial);
+        }
+
+        if(!status && st->workLimit > 0) {
+            // The formula would be too large for the limited work
+            st->exhausted = 1;
+            st->nextCount = 0;
+            return 0;
+        }
+        if(!status) {
+            // Too many clauses: keep the current formula and buffer the rest of the word
+            log_warn(AUTOMATON, "Stream formula exceeds %d clauses - buffering the rest of the word.", ACCEPT_STREAM_CLAUSE_LIMIT);
+            st->nextCount = 0;
+            st->pendingCapacity = (ACCEPT_STREAM_PENDING_LIMIT < 1024) ? ACCEPT_STREAM_PENDING_LIMIT : 1024;
+            st->pending = MALLOCATE_ARRAY(char, st->pendingCapacity);
+            st->pending[st->pendingLength++] = chunk[i];
+            continue;
+        }
+
+        uint64_t* swap = st->clauses;
+        st->clauses = st->next;
+        st->next = swap;
+        const int swapCapacity = st->capacity;
+        st->capacity = st->nextCapacity;
+        st->nextCapacity = swapCapacity;
+        st->clauseCount = st->nextCount;
+        st->nextCount = 0;
+    }
+    return !st->exhausted;
+}
+
+/**
+ * Returns the verdict for the word received so far.
+ * The stream is not modified, so more chunks can be fed afterwards.
+ * It takes a backward step per buffered letter (at most ACCEPT_STREAM_PENDING_LIMIT).
+ *
+ * @param[in] st : Streaming evaluator
+ * @returns If the word received so far is accepted (-1 if the stream is exhausted, see acceptStreamFeed)?
+ */
+int acceptStreamVerdict(AcceptStream st) {
+    if(st->exhausted) {
+        return -1;
+    }
+    const TransitionGraph tg = st->tg;
+    const int words = tg->setWords;
+    uint64_t sets[2][words];
+    int current = 0;
+
+    // Set of states accepting the buffered suffix (empty suffix when the formula is not frozen)
+    stateSetCopy(sets[current], tg->acceptingMask, words);
+    for(int i=st->pendingLength-1;i>=0;--i) {
+        stateSetStepBack(tg, sets[current], letterClassOf(tg, st->pending[i]), sets[!current]);
+        current = !current;
+    }
+
+    for(int k=0;k<st->clauseCount;++k) {
+        if(acceptStreamSubset(&(st->clauses[k * words]), sets[current], words)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#endif // __AUTOMATON_STREAM_H__
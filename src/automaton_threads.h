@@ -0,0 +1,565 @@
+/** @file
+*
+*  Work-stealing multithreaded accept (C11 standard)
+*
+*  The run tree is evaluated by a pool of threads. Each thread owns a deque of tasks
+*  (a task is a subtree of the run tree: state and position in the word). The owner pushes and pops
+*  tasks at the tail of its deque and idle threads steal the oldest (the biggest) tasks from the head.
+*
+*  A task is evaluated sequentially (depth first, the path is recorded as a stack of frames).
+*  Every ACCEPT_THREADS_TASK_BUDGET nodes the thread checks if there are idle threads.
+*  If so, the unexplored successors of the topmost frame on the stack are published as new tasks,
+*  so the biggest pending subtrees are split first and no work is ever repeated.
+*
+*  Results are propagated to the parent tasks: an accepting successor of an existential state or
+*  a rejecting successor of an universal state resolves the parent at once, so all its
+*  remaining subtasks are cancelled (they notice it cooperatively and stop).
+*
+*  No memory is allocated by the threads - all the tasks, frames and deques are preallocated.
+*
+*  @author Piotr Styczyński <piotrsty1@gmail.com>
+*  @copyright MIT
+*  @date 2018-01-21
+*/
+#ifndef __AUTOMATON_THREADS_H__
+#define __AUTOMATON_THREADS_H__
+
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "automaton.h"
+#include "memalloc.h"
+#include "syslog.h"
+
+/*
+ * Special values of the sequential evaluation (results are 0 or 1)
+ */
+#define ACCEPT_THREADS_DELEGATED  -2
+#define ACCEPT_THREADS_CANCELLED  -1
+
+typedef struct AcceptThreadsTask AcceptThreadsTask;
+typedef struct AcceptThreadsFrame AcceptThreadsFrame;
+typedef struct AcceptThreadsDeque AcceptThreadsDeque;
+typedef struct AcceptThreadsContext AcceptThreadsContext;
+typedef struct AcceptThreadsWorker AcceptThreadsWorker;
+
+/**
+ * Structure to hold single task
+ *
+ * The task waits for pending results of its subtrees (pending is 1 for a fresh task).
+ * The task is alive as long as it's executed or any of its subtasks is alive (refs counts that).
+ */
+struct AcceptThreadsTask {
+    int state;
+    int depth;
+    int parent;
+    int existential;
+    atomic_int pending;
+    atomic_int refs;
+    atomic_int resolved;
+};
+
+/**
+ * Structure to hold single node on the stack of sequential evaluation
+ *
+ * split is the task created when the unexplored successors of the node were published (or -1).
+ */
+struct AcceptThreadsFrame {
+    const int* targets;
+    int state;
+    int depth;
+    int next;
+    int count;
+    int split;
+};
+
+/**
+ * Structure to hold deque of tasks owned by one thread
+ * Items between head and tail (modulo capacity) are tasks waiting for execution.
+ */
+struct AcceptThreadsDeque {
+    pthread_mutex_t lock;
+    int* items;
+    int head;
+    int tail;
+};
+
+/**
+ * Structure to hold state shared by all threads of single acceptThreads call
+ */
+struct AcceptThreadsContext {
+    TransitionGraph tg;
+    char* word;
+    int word_len;
+    int prune;
+
+    AcceptThreadsTask* tasks;
+    int capacity;
+    int* freeSlots;
+    int freeCount;
+    pthread_mutex_t freeLock;
+
+    AcceptThreadsDeque* deques;
+    int threadCount;
+
+    atomic_int queued;
+    atomic_int sleeping;
+    atomic_int done;
+    pthread_mutex_t idleLock;
+    pthread_cond_t idleCond;
+
+    int result;
+};
+
+/**
+ * Structure to hold thread details
+ */
+struct AcceptThreadsWorker {
+    AcceptThreadsContext* ctx;
+    int id;
+    pthread_t thread;
+    AcceptThreadsFrame* frames;
+    int owner;
+    int budget;
+    long long nodes; ///< number of the nodes expanded by the thread (see AcceptTuning)
+};
+
+/**
+ * Wakes up all idle threads.
+ *
+ * @param[in] ctx : Context of the accept
+ */
+static void acceptThreads_wake(AcceptThreadsContext* ctx) {
+    pthread_mutex_lock(&ctx->idleLock);
+    pthread_cond_broadcast(&ctx->idleCond);
+    pthread_mutex_unlock(&ctx->idleLock);
+}
+
+/**
+ * Takes count free task slots and initializes them as fresh tasks.
+ *
+ * @param[in]  ctx    : Context of the accept
+ * @param[in]  count  : Number of slots to take
+ * @param[in]  parent : Parent of the new tasks
+ * @param[out] slots  : Taken slots
+ * @returns If there were enough free slots? (if not, nothing is taken)
+ */
+static int acceptThreads_alloc(AcceptThreadsContext* ctx, int count, int parent, int* slots) {
+    int status = 0;
+    pthread_mutex_lock(&ctx->freeLock);
+    if(ctx->freeCount >= count) {
+        for(int i=0;i<count;++i) {
+            slots[i] = ctx->freeSlots[--ctx->freeCount];
+        }
+        status = 1;
+    }
+    pthread_mutex_unlock(&ctx->freeLock);
+
+    if(!status) {
+        return 0;
+    }
+    for(int i=0;i<count;++i) {
+        AcceptThreadsTask* t = &ctx->tasks[slots[i]];
+        t->parent = parent;
+        t->existential = 0;
+        atomic_store(&t->pending, 1);
+        atomic_store(&t->refs, 1);
+        atomic_store(&t->resolved, 0);
+    }
+    if(parent != -1) {
+        atomic_fetch_add(&ctx->tasks[parent].refs, count);
+    }
+    return 1;
+}
+
+/**
+ * Drops one reference to the task.
+ * Dead tasks are returned to the free slots and drop their references to the parents.
+ *
+ * @param[in] ctx  : Context of the accept
+ * @param[in] task : Task slot
+ */
+static void acceptThreads_release(AcceptThreadsContext* ctx, int task) {
+    while(task != -1 && atomic_fetch_sub(&ctx->tasks[task].refs, 1) == 1) {
+        const int parent = ctx->tasks[task].parent;
+        pthread_mutex_lock(&ctx->freeLock);
+        ctx->freeSlots[ctx->freeCount++] = task;
+        pthread_mutex_unlock(&ctx->freeLock);
+        task = parent;
+    }
+}
+
+/**
+ * Check if result of the task is no longer needed.
+ * That's the case if the task or any of its ancestors is already resolved.
+ *
+ * @param[in] ctx  : Context of the accept
+ * @param[in] task : Task slot
+ * @returns If the task is cancelled?
+ */
+static int acceptThreads_cancelled(AcceptThreadsContext* ctx, int task) {
+    if(atomic_load(&ctx->done)) {
+        return 1;
+    }
+    for(;task != -1;task = ctx->tasks[task].parent) {
+        if(atomic_load(&ctx->tasks[task].resolved)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Delivers result of one of the pending subtrees to the task.
+ * If it decides the value of the task then the task is resolved and its result
+ * is delivered to its parent.
+ *
+ * @param[in] ctx    : Context of the accept
+ * @param[in] task   : Task slot
+ * @param[in] result : Result of the subtree
+ */
+static void acceptThreads_deliver(AcceptThreadsContext* ctx, int task, int result) {
+    while(task != -1) {
+        AcceptThreadsTask* t = &ctx->tasks[task];
+
+        // Accepting existential or rejecting universal branch decides (so does the last branch)
+        if(t->existential != result && atomic_fetch_sub(&t->pending, 1) != 1) {
+            return;
+        }
+        int expected = 0;
+        if(!atomic_compare_exchange_strong(&t->resolved, &expected, 1)) {
+            return;
+        }
+
+        if(t->parent == -1) {
+            ctx->result = result;
+            atomic_store(&ctx->done, 1);
+            acceptThreads_wake(ctx);
+            return;
+        }
+        task = t->parent;
+    }
+}
+
+/**
+ * Pushes the task to the tail of the thread deque.
+ *
+ * @param[in] ctx  : Context of the accept
+ * @param[in] id   : Thread id
+ * @param[in] task : Task slot
+ */
+static void acceptThreads_push(AcceptThreadsContext* ctx, int id, int task) {
+    AcceptThreadsDeque* dq = &ctx->deques[id];
+    pthread_mutex_lock(&dq->lock);
+    dq->items[dq->tail % ctx->capacity] = task;
+    ++(dq->tail);
+    pthread_mutex_unlock(&dq->lock);
+
+    atomic_fetch_add(&ctx->queued, 1);
+    if(atomic_load(&ctx->sleeping) > 0) {
+        acceptThreads_wake(ctx);
+    }
+}
+
+/**
+ * Takes task from the deque.
+ * The owner takes the newest task (from the tail) and thieves the oldest one (from the head).
+ *
+ * @param[in] ctx   : Context of the accept
+ * @param[in] id    : Thread id of the deque owner
+ * @param[in] steal : If the task is stolen?
+ * @returns Task slot or -1 if the deque is empty
+ */
+static int acceptThreads_take(AcceptThreadsContext* ctx, int id, int steal) {
+    AcceptThreadsDeque* dq = &ctx->deques[id];
+    int task = -1;
+    pthread_mutex_lock(&dq->lock);
+    if(dq->head != dq->tail) {
+        if(steal) {
+            task = dq->items[dq->head % ctx->capacity];
+            ++(dq->head);
+        } else {
+            --(dq->tail);
+            task = dq->items[dq->tail % ctx->capacity];
+        }
+        if(dq->head == dq->tail) {
+            dq->head = 0;
+            dq->tail = 0;
+        }
+    }
+    pthread_mutex_unlock(&dq->lock);
+
+    if(task != -1) {
+        atomic_fetch_sub(&ctx->queued, 1);
+    }
+    return task;
+}
+
+/**
+ * Publishes unexplored successors of the topmost frame that has any as new tasks.
+ * The frame gets its own task which collects results of the published successors and
+ * of the successor explored now, so the frames above it are no longer needed.
+ *
+ * The task receiving result of the current frame (worker->owner) is updated.
+ *
+ * @param[in] worker : Thread details
+ * @param[in] top    : Index of the current frame
+ */
+static void acceptThreads_split(AcceptThreadsWorker* worker, int top) {
+    AcceptThreadsContext* ctx = worker->ctx;
+    TransitionGraph tg = ctx->tg;
+
+    for(int j=0;j<top;++j) {
+        AcceptThreadsFrame* f = &worker->frames[j];
+        if(f->next >= f->count) {
+            continue;
+        }
+
+        const int remaining = f->count - f->next;
+        int slots[remaining + 1];
+        if(!acceptThreads_alloc(ctx, 1, worker->owner, slots)) {
+            return;
+        }
+        if(!acceptThreads_alloc(ctx, remaining, slots[0], slots+1)) {
+            acceptThreads_release(ctx, slots[0]);
+            return;
+        }
+
+        AcceptThreadsTask* split = &ctx->tasks[slots[0]];
+        split->state = f->state;
+        split->depth = f->depth;
+        split->existential = (f->state >= tg->U);
+        atomic_store(&split->pending, remaining + 1);
+
+        // Push in reverse order, so the earlier branches are taken first by the owner
+        for(int i=remaining;i>=1;--i) {
+            AcceptThreadsTask* sub = &ctx->tasks[slots[i]];
+            sub->state = f->targets[f->next + i - 1];
+            sub->depth = f->depth + 1;
+            acceptThreads_push(ctx, worker->id, slots[i]);
+        }
+
+        f->next = f->count;
+        f->split = slots[0];
+        worker->owner = slots[0];
+        return;
+    }
+}
+
+/**
+ * Sequentially evaluates the run subtree (publishing its parts if other threads are idle).
+ * Frames of the evaluated path are kept in worker->frames, so they can be split.
+ *
+ * @param[in] worker        : Thread details
+ * @param[in] level         : Index of the frame of the node
+ * @param[in] current_state : Current state of the automaton
+ * @param[in] depth         : Position in word correlated with the current state
+ * @returns Is the subtree accepting? (or one of ACCEPT_THREADS_* special values)
+ */
+static int acceptThreads_seq(AcceptThreadsWorker* worker, int level, int current_state, int depth) {
+    AcceptThreadsContext* ctx = worker->ctx;
+    TransitionGraph tg = ctx->tg;
+
+    ++(worker->nodes);
+
+    if(depth >= ctx->word_len) {
+        return tg->acceptingStates[current_state];
+    }
+
+    if(ctx->prune) {
+        const int known = acceptPrune(tg, current_state, ctx->word_len - depth);
+        if(known != -1) {
+            return known;
+        }
+    }
+
+    if(--(worker->budget) <= 0) {
+        worker->budget = ACCEPT_THREADS_TASK_BUDGET;
+        if(acceptThreads_cancelled(ctx, worker->owner)) {
+            return ACCEPT_THREADS_CANCELLED;
+        }
+        if(atomic_load(&ctx->sleeping) > 0 && atomic_load(&ctx->queued) <= 0) {
+            acceptThreads_split(worker, level);
+        }
+    }
+
+    const int current_class = letterClassOf(tg, ctx->word[depth]);
+    const int existential = (current_state >= tg->U);
+    AcceptThreadsFrame* f = &worker->frames[level];
+    f->state = current_state;
+    f->depth = depth;
+    f->next = 0;
+    f->count = transitionCount(tg, current_state, current_class);
+    f->targets = transitionTargets(tg, current_state, current_class);
+    f->split = -1;
+
+    while(f->next < f->count) {
+        const int value = acceptThreads_seq(worker, level+1, f->targets[f->next++], depth+1);
+
+        if(f->split != -1) {
+            // Result of the explored successor goes to the task of the frame
+            const int split = f->split;
+            worker->owner = ctx->tasks[split].parent;
+            if(value >= 0) {
+                acceptThreads_deliver(ctx, split, value);
+            }
+            acceptThreads_release(ctx, split);
+            return (value >= 0) ? ACCEPT_THREADS_DELEGATED : value;
+        }
+        if(value < 0 || value == existential) {
+            return value;
+        }
+    }
+
+    // All successors explored and none decided
+    return !existential;
+}
+
+/**
+ * Main loop of the accept thread.
+ * Executes own tasks, steals tasks from other threads or sleeps if there are no tasks.
+ *
+ * @param[in] arg : Pointer to AcceptThreadsWorker
+ * @returns NULL
+ */
+static void* acceptThreads_worker(void* arg) {
+    AcceptThreadsWorker* worker = (AcceptThreadsWorker*) arg;
+    AcceptThreadsContext* ctx = worker->ctx;
+    const int id = worker->id;
+
+    while(!atomic_load(&ctx->done)) {
+        int task = acceptThreads_take(ctx, id, 0);
+        for(int i=1;task == -1 && i<ctx->threadCount;++i) {
+            task = acceptThreads_take(ctx, (id+i) % ctx->threadCount, 1);
+        }
+
+        if(task != -1) {
+            if(!acceptThreads_cancelled(ctx, task)) {
+                worker->owner = task;
+                worker->budget = ACCEPT_THREADS_TASK_BUDGET;
+                const int value = acceptThreads_seq(worker, 0, ctx->tasks[task].state, ctx->tasks[task].depth);
+                if(value >= 0) {
+                    acceptThreads_deliver(ctx, task, value);
+                }
+            }
+            acceptThreads_release(ctx, task);
+            continue;
+        }
+
+        pthread_mutex_lock(&ctx->idleLock);
+        atomic_fetch_add(&ctx->sleeping, 1);
+        while(!atomic_load(&ctx->done) && atomic_load(&ctx->queued) <= 0) {
+            pthread_cond_wait(&ctx->idleCond, &ctx->idleLock);
+        }
+        atomic_fetch_sub(&ctx->sleeping, 1);
+        pthread_mutex_unlock(&ctx->idleLock);
+    }
+    return NULL;
+}
+
+/**
+ * Calculates accept() on the transition graph nodes.
+ * This function uses work-stealing multithreaded approach (see file description) and
+ * spawns no processes.
+ *
+ * Gives the same answers as acceptSync.
+ * The expanded nodes and the processor time are added to acceptTuning, so the overhead of the threads is measured.
+ *
+ * @param [in] tg            : Transition graph
+ * @param [in] word          : Input word
+ * @return Is the word accepted by automaton defined by transition graph?
+ */
+int acceptThreads(TransitionGraph tg, char* word) {
+    const clock_t startTime = clock();
+    int thread_count = ACCEPT_THREADS_COUNT;
+    if(thread_count <= 0) {
+        thread_count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if(thread_count <= 0) {
+        thread_count = 1;
+    }
+
+    AcceptThreadsContext ctx;
+    ctx.tg = tg;
+    ctx.word = word;
+    ctx.word_len = strlen(word);
+    ctx.prune = wordInAlphabet(tg, word, ctx.word_len);
+    ctx.capacity = ACCEPT_THREADS_TASK_LIMIT;
+    ctx.tasks = MALLOCATE_ARRAY(AcceptThreadsTask, ctx.capacity);
+    ctx.freeSlots = MALLOCATE_ARRAY(int, ctx.capacity);
+    ctx.threadCount = thread_count;
+    ctx.deques = MALLOCATE_ARRAY(AcceptThreadsDeque, thread_count);
+    ctx.result = 0;
+
+    for(int i=0;i<ctx.capacity;++i) {
+        atomic_init(&ctx.tasks[i].pending, 0);
+        atomic_init(&ctx.tasks[i].refs, 0);
+        atomic_init(&ctx.tasks[i].resolved, 0);
+        ctx.freeSlots[i] = ctx.capacity-1-i;
+    }
+    ctx.freeCount = ctx.capacity;
+    for(int i=0;i<thread_count;++i) {
+        pthread_mutex_init(&ctx.deques[i].lock, NULL);
+        ctx.deques[i].items = MALLOCATE_ARRAY(int, ctx.capacity);
+        ctx.deques[i].head = 0;
+        ctx.deques[i].tail = 0;
+    }
+    pthread_mutex_init(&ctx.freeLock, NULL);
+    pthread_mutex_init(&ctx.idleLock, NULL);
+    pthread_cond_init(&ctx.idleCond, NULL);
+    atomic_init(&ctx.queued, 0);
+    atomic_init(&ctx.sleeping, 0);
+    atomic_init(&ctx.done, 0);
+
+    // The root task
+    int root = 0;
+    acceptThreads_alloc(&ctx, 1, -1, &root);
+    ctx.tasks[root].state = tg->q0;
+    ctx.tasks[root].depth = 0;
+    acceptThreads_push(&ctx, 0, root);
+
+    // The calling thread is the worker 0
+    AcceptThreadsWorker* workers = MALLOCATE_ARRAY(AcceptThreadsWorker, thread_count);
+    AcceptThreadsFrame* frames = MALLOCATE_ARRAY(AcceptThreadsFrame, (size_t) thread_count * (ctx.word_len + 1));
+    int started = 1;
+    for(int i=0;i<thread_count;++i) {
+        workers[i].ctx = &ctx;
+        workers[i].id = i;
+        workers[i].frames = frames + (size_t) i * (ctx.word_len + 1);
+        workers[i].nodes = 0;
+    }
+    for(int i=1;i<thread_count;++i) {
+        if(pthread_create(&workers[i].thread, NULL, acceptThreads_worker, &workers[i]) != 0) {
+            log_warn(RUN, "Failed to create accept thread, continue with %d threads.", started);
+            break;
+        }
+        ++started;
+    }
+    acceptThreads_worker(&workers[0]);
+    for(int i=1;i<started;++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    for(int i=0;i<started;++i) {
+        acceptTuning.threadNodes += workers[i].nodes;
+    }
+    acceptTuning.threads += started;
+
+    for(int i=0;i<thread_count;++i) {
+        pthread_mutex_destroy(&ctx.deques[i].lock);
+        FREE(ctx.deques[i].items);
+    }
+    pthread_mutex_destroy(&ctx.freeLock);
+    pthread_mutex_destroy(&ctx.idleLock);
+    pthread_cond_destroy(&ctx.idleCond);
+    FREE(frames);
+    FREE(workers);
+    FREE(ctx.deques);
+    FREE(ctx.freeSlots);
+    FREE(ctx.tasks);
+
+    acceptTuning.threadTime += clock() - startTime;
+    return ctx.result;
+}
+
+#endif // __AUTOMATON_THREADS_H__
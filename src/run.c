@@ -22,6 +22,10 @@
 
 #include "getline.h"
 #include "automaton.h"
+#include "automaton_compiler.h"
+#include "automaton_threads.h"
+#include "automaton_dispatch.h"
+#include "automaton_image.h"
 #include "msg_queue.h"
 #include "msg_pipe.h"
 #include "fork.h"
@@ -47,9 +51,13 @@ void parent_killed_sig_handler(int sig) {
 /*
  * Valid execution parameters:
  *
- *    run <stringified_MsgPipe_object> <word_to_parse> [-v]
+ *    run <stringified_MsgPipe_object> <word_to_parse> [-v] [-c <compiled_automaton_path>] [-e <engine>] [-t <node_cost> <spawn_cost> <thread_cost>] [-g <graph_image>]
  *
  *   -v flag is used to indicate verbosive logging
+ *   -c flag points to automaton compiled by validator (see automaton_compiler.h)
+ *   -e flag forces the accept engine (see automaton_dispatch.h), by default it's chosen per word
+ *   -t flag passes the costs learned by validator (see AcceptTuning in automaton.h)
+ *   -g flag names the graph image shared by validator (see automaton_image.h), then the pipe is "-"
  * 
  *   The run command should not be ever executed by user.
  *   It's internal worker of the server.
@@ -87,9 +95,26 @@ int main(int argc, char *argv[]) {
     }
     
     log_set(0);
-    for(int i=1;i<argc;++i) {
+    const char* compiled_path = NULL;
+    const char* graph_image_name = NULL;
+    AcceptEngine engine = ACCEPT_ENGINE_AUTO;
+    for(int i=3;i<argc;++i) {
         if(strcmp(argv[i], "-v") == 0) {
             log_set(1);
+        } else if(strcmp(argv[i], "-c") == 0 && i+1 < argc) {
+            compiled_path = argv[++i];
+        } else if(strcmp(argv[i], "-e") == 0 && i+1 < argc) {
+            engine = acceptEngineFromName(argv[++i]);
+            if(engine == ACCEPT_ENGINE_COUNT) {
+                log_warn(RUN, "Unknown accept engine %s - choose it automatically.", argv[i]);
+                engine = ACCEPT_ENGINE_AUTO;
+            }
+        } else if(strcmp(argv[i], "-t") == 0 && i+3 < argc) {
+            acceptTuning.nodeCost = atof(argv[++i]);
+            acceptTuning.spawnCost = atof(argv[++i]);
+            acceptTuning.threadCost = atof(argv[++i]);
+        } else if(strcmp(argv[i], "-g") == 0 && i+1 < argc) {
+            graph_image_name = argv[++i];
         }
     }
     
@@ -104,9 +129,13 @@ int main(int argc, char *argv[]) {
     // Queue to write termination status
     MsgQueue runOutputQueue = msgQueueOpen("/FinAutomRunOutQueue", LINE_BUF_SIZE, MSG_QUEUE_SIZE);
 
-    // Capture pipe by which the server will send the graph representation
-    MsgPipeID graphDataPipeID = msgPipeIDFromStr(argv[1]);
-    MsgPipe graphDataPipe = msgPipeOpen(graphDataPipeID);
+    // Capture pipe by which the server will send the graph representation (unless the graph image is shared)
+    const int use_graph_pipe = (graph_image_name == NULL);
+    MsgPipe graphDataPipe;
+    if(use_graph_pipe) {
+        MsgPipeID graphDataPipeID = msgPipeIDFromStr(argv[1]);
+        graphDataPipe = msgPipeOpen(graphDataPipeID);
+    }
     
     log(RUN, "Ready.");
     
@@ -116,20 +145,30 @@ int main(int argc, char *argv[]) {
         exit(-1);
     }
     
-    log(RUN, "Wait for graph data");
-    
-    // Load transition graph description
-    char* transitionGraphDesc = msgPipeRead(graphDataPipe);
-    if(transitionGraphDesc == NULL) {
-        fatal(RUN, "Received empty graph description.");
+    TransitionGraph tg;
+    if(use_graph_pipe) {
+        log(RUN, "Wait for graph data");
+        
+        // Load transition graph description
+        char* transitionGraphDesc = msgPipeRead(graphDataPipe);
+        if(transitionGraphDesc == NULL) {
+            fatal(RUN, "Received empty graph description.");
+        }
+        log(RUN, "Received graph description: %d bytes", strlen(transitionGraphDesc));
+        
+        // Load transition graph from its description
+        tg = newTransitionGraph();
+        char* transitionGraphDescIter = transitionGraphDesc;
+        initTransitionGraph(tg);
+        loadTransitionGraph(&transitionGraphDescIter, tg);
+    } else {
+        // Map the graph parsed by the server
+        tg = mapTransitionGraphImage(graph_image_name);
+        if(tg == NULL) {
+            fatal(RUN, "Failed to map the graph image %s", graph_image_name);
+        }
+        log(RUN, "Mapped graph image %s", graph_image_name);
     }
-    log(RUN, "Received graph description: %d bytes", strlen(transitionGraphDesc));
-    
-    // Load transition graph from its description
-    TransitionGraph tg = newTransitionGraph();
-    char* transitionGraphDescIter = transitionGraphDesc;
-    initTransitionGraph(tg);
-    loadTransitionGraph(&transitionGraphDescIter, tg);
 
 #if DEBUG_TRANSFERRED_GRAPH == 1
     printTransitionGraph(tg);
@@ -137,13 +176,39 @@ int main(int argc, char *argv[]) {
     
     log(RUN, "Received word to parse: %s", word_to_parse);
     
-    // Run sync/async accept on the received word
+    // Load the compiled automaton if the server has built one
+    CompiledAutomaton compiled = NULL;
+    if(compiled_path != NULL) {
+        compiled = loadCompiledAutomaton(tg, compiled_path);
+        if(compiled == NULL) {
+            log_warn(RUN, "Compiled automaton is unavailable - fall back to the generic engine.");
+        }
+    }
     
-#if USE_ASYNC_ACCEPT == 1
-    const int result = acceptAsync(tg, word_to_parse);
-#else
-    const int result = acceptSync(tg, word_to_parse);
+    // Run compiled accept or the engine chosen for the received word
+    int result;
+    int tuned = 0;
+    if(compiled != NULL) {
+        log_ok(RUN, "Engine: compiled");
+        result = acceptCompiled(compiled, word_to_parse);
+        freeCompiledAutomaton(compiled);
+    } else {
+#if USE_ASYNC_ACCEPT == 0
+        if(engine == ACCEPT_ENGINE_ASYNC) {
+            engine = ACCEPT_ENGINE_AUTO;
+        }
 #endif
+        if(engine == ACCEPT_ENGINE_AUTO) {
+            AcceptEngineStats stats;
+            engine = selectAcceptEngine(tg, NULL, word_to_parse, &stats);
+            log_ok(RUN, "Engine: %s (chosen for Q=%d, branching=%.2f, universal=%.2f, |w|=%d, run tree %.0f)", acceptEngineName(engine), tg->Q, stats.branching, stats.universalRatio, (int) strlen(word_to_parse), stats.treeCost);
+        } else {
+            log_ok(RUN, "Engine: %s (forced)", acceptEngineName(engine));
+        }
+        acceptTuningReset();
+        result = acceptWithEngine(tg, NULL, engine, word_to_parse);
+        tuned = acceptTuningUpdate();
+    }
 
     if(result) {
         log_ok(RUN, "Result: %s A", word_to_parse);
@@ -158,11 +223,20 @@ int main(int argc, char *argv[]) {
     }
     
     // Commit results to the server
-    msgQueueWritef(runOutputQueue, "run-terminate: %lld %d", (long long)getpid(), result);
+    if(tuned) {
+        // Report the measured costs as well
+        msgQueueWritef(runOutputQueue, "run-terminate: %lld %d %.1f %.1f %.1f", (long long)getpid(), result, acceptTuning.nodeCost, acceptTuning.spawnCost, acceptTuning.threadCost);
+    } else {
+        msgQueueWritef(runOutputQueue, "run-terminate: %lld %d", (long long)getpid(), result);
+    }
     
     // Close all means of communication
     msgQueueClose(&runOutputQueue);
-    msgPipeClose(&graphDataPipe);
+    if(use_graph_pipe) {
+        msgPipeClose(&graphDataPipe);
+    } else {
+        unmapTransitionGraphImage(tg);
+    }
     
     log(RUN, "Terminate.");
     
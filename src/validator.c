@@ -35,6 +35,10 @@
 #include <string.h>
 #include "getline.h"
 #include "automaton.h"
+#include "automaton_compiler.h"
+#include "automaton_stream.h"
+#include "automaton_dispatch.h"
+#include "automaton_image.h"
 #include "msg_queue.h"
 #include "msg_pipe.h"
 #include "onexit.h"
@@ -53,6 +57,7 @@ typedef struct TesterSlot TesterSlot;
 struct RunSlot {
     MsgPipeID graphDataPipeID;
     MsgPipe graphDataPipe;
+    int hasGraphPipe;   ///< was the graph description sent by the pipe (instead of the shared image)?
     pid_t pid;
     pid_t testerSourcePid;
     int loc_id;
@@ -67,6 +72,10 @@ struct TesterSlot {
     MsgQueue testerInputQueue;
     int rcd_count;
     int acc_count;
+    char lastWord[LINE_BUF_SIZE]; ///< the previous word sent by the tester
+    int lastWordValid;            ///< if lastWord was already set?
+    AcceptStream snapshot;        ///< evaluator positioned after lastWord (NULL if not built yet)
+    int snapshotExhausted;        ///< if the snapshot exceeded the work limit (for lastWord and its extensions)
 };
 
 /**
@@ -74,6 +83,47 @@ struct TesterSlot {
  */
 int verboseMode = 0;
 
+/**
+ * In compile mode the automaton is compiled to native code which is then used by run workers.
+ */
+int compileMode = 0;
+
+/**
+ * Accept engine forced with -e option (NULL if the workers choose it per word).
+ */
+const char* engineName = NULL;
+
+/**
+ * Path of the binary automaton (.autb) loaded with -i option instead of the description from stdin (NULL if not given).
+ */
+const char* graphImageInputPath = NULL;
+
+/**
+ * Path of the binary automaton (.autb) written with -o option (NULL if not given).
+ * The server converts the automaton from stdin and exits.
+ */
+const char* graphImageOutputPath = NULL;
+
+/**
+ * Costs of the run tree node expansion, of the fork and of the accept thread (in nanoseconds) learned from the workers.
+ * They are passed to the new workers (see AcceptTuning in automaton.h).
+ */
+double learnedNodeCost = RUN_NODE_COST;
+double learnedSpawnCost = RUN_SPAWN_COST;
+double learnedThreadCost = RUN_THREAD_COST;
+
+/**
+ * Name of the shared memory object with the graph image mapped by the workers (see automaton_image.h).
+ */
+char graphImageName[64];
+int graphImageShared = 0;
+
+/**
+ * Path of the automaton compiled with -c option (see automaton_compiler.h) loaded by the workers.
+ */
+char compiledAutomatonPath[PATH_MAX];
+int compiledAvailable = 0;
+
 int slots_inited = 0;
 HashMap runSlots;
 HashMap testerSlots;
@@ -82,6 +132,18 @@ HashMap testerSlots;
  * Custom server exit handler to send exit messages to all of registered the testers
  */
 void onExit() {
+    // The graph image would outlive the server
+    if(graphImageShared) {
+        removeTransitionGraphImage(graphImageName);
+        graphImageShared = 0;
+    }
+    
+    // The same for the compiled automaton
+    if(compiledAvailable) {
+        unlink(compiledAutomatonPath);
+        compiledAvailable = 0;
+    }
+    
     // There's nothing that we can do
     // In case of slots_inited = 1 the slots are broken for sure
     // We cannot read them
@@ -94,6 +156,65 @@ void onExit() {
     }
 }
 
+/**
+ * Answers the word in the server if it extends the previous word of the same tester.
+ * The session snapshot (see automaton_stream.h) is then fed only with the appended letters.
+ *
+ * The snapshot is built when the tester sends the first word extending the previous one,
+ * so the sessions that never extend their words cost nothing.
+ * The work done in the server is limited by SERVER_SNAPSHOT_WORK_LIMIT: when it's exceeded
+ * the snapshot is dropped and the word is left to the worker (and so are the further extensions of the word,
+ * as their formulas are not smaller).
+ * The word becomes the new previous word of the tester in all the cases.
+ *
+ * @param[in] ts     : Tester session
+ * @param[in] tg     : Transition graph (used by the workers)
+ * @param[in] word   : Received word
+ * @param[in] result : Pointer to the variable receiving the verdict
+ * @returns If the word was answered (if not, the worker must be spawned)?
+ */
+int testerSlotResume(TesterSlot* ts, TransitionGraph tg, const char* word, int* result) {
+    const int wordLength = strlen(word);
+    const int lastLength = strlen(ts->lastWord);
+    int answered = 0;
+
+    const int extends = ts->lastWordValid && lastLength <= wordLength && strncmp(ts->lastWord, word, lastLength) == 0;
+    if(!extends) {
+        ts->snapshotExhausted = 0;
+    }
+
+    if(extends && !ts->snapshotExhausted) {
+        int fed = 1;
+        if(ts->snapshot == NULL) {
+            ts->snapshot = newAcceptStream(tg);
+            acceptStreamSetWorkLimit(ts->snapshot, SERVER_SNAPSHOT_WORK_LIMIT);
+            fed = acceptStreamFeed(ts->snapshot, ts->lastWord, lastLength);
+        } else {
+            acceptStreamSetWorkLimit(ts->snapshot, SERVER_SNAPSHOT_WORK_LIMIT);
+        }
+        if(fed) {
+            fed = acceptStreamFeed(ts->snapshot, word + lastLength, wordLength - lastLength);
+        }
+        if(fed) {
+            *result = acceptStreamVerdict(ts->snapshot);
+            answered = 1;
+        } else {
+            log(SERVER, "Word {%s} exceeds the session snapshot work limit - snapshot dropped", word);
+            freeAcceptStream(ts->snapshot);
+            ts->snapshot = NULL;
+            ts->snapshotExhausted = 1;
+        }
+    } else if(ts->snapshot != NULL) {
+        // The snapshot is rebuilt for the new word when it's extended
+        freeAcceptStream(ts->snapshot);
+        ts->snapshot = NULL;
+    }
+
+    strcpy(ts->lastWord, word);
+    ts->lastWordValid = 1;
+    return answered;
+}
+
 int main(int argc, char *argv[]) {
     
     GC_SETUP();
@@ -104,6 +225,17 @@ int main(int argc, char *argv[]) {
         if(strcmp(argv[i], "-v") == 0) {
             log_set(1);
             verboseMode = 1;
+        } else if(strcmp(argv[i], "-c") == 0) {
+            compileMode = 1;
+        } else if(strcmp(argv[i], "-e") == 0 && i+1 < argc) {
+            engineName = argv[++i];
+            if(acceptEngineFromName(engineName) == ACCEPT_ENGINE_COUNT) {
+                fatal(SERVER, "Unknown accept engine %s (use one of: auto, sync, iterative, async, memo, bitset, lazy, threads)", engineName);
+            }
+        } else if(strcmp(argv[i], "-i") == 0 && i+1 < argc) {
+            graphImageInputPath = argv[++i];
+        } else if(strcmp(argv[i], "-o") == 0 && i+1 < argc) {
+            graphImageOutputPath = argv[++i];
         }
     }
     
@@ -119,8 +251,101 @@ int main(int argc, char *argv[]) {
     // The final returned exit code during normal operation
     int server_status_code = 0;
     
-    // Load transition graph description from the standard input
-    char* transitionGraphDesc = loadTransitionGraphDescFromStdin();
+    // The automaton is parsed once and shared by the minimization, compile mode and tester sessions
+    char* transitionGraphDesc = NULL;
+    TransitionGraph serverGraph = NULL;
+    if(graphImageInputPath != NULL) {
+        // The binary automaton is mapped as it is (it was already reduced when converted)
+        serverGraph = loadTransitionGraphImageFile(graphImageInputPath);
+        if(serverGraph == NULL) {
+            fatal(SERVER, "Failed to load the binary automaton %s", graphImageInputPath);
+        }
+        log_ok(SERVER, "Automaton mapped from %s (%d states)", graphImageInputPath, serverGraph->Q);
+    } else {
+        // Load transition graph description from the standard input
+        transitionGraphDesc = loadTransitionGraphDescFromStdin();
+        serverGraph = newTransitionGraph();
+        char* transitionGraphDescIter = transitionGraphDesc;
+        loadTransitionGraph(&transitionGraphDescIter, serverGraph);
+    }
+
+#if USE_AUTOMATON_MINIMIZATION == 1
+    /*
+     * Reduce the automaton once, so that all the workers receive (and evaluate) the smaller graph.
+     */
+    if(transitionGraphDesc != NULL) {
+        const int originalStates = serverGraph->Q;
+        if(minimizeTransitionGraph(serverGraph)) {
+            log_ok(SERVER, "Automaton reduced from %d to %d states (ratio %.3f)", originalStates, serverGraph->Q, (double) serverGraph->Q / originalStates);
+            FREE(transitionGraphDesc);
+            transitionGraphDesc = saveTransitionGraphDesc(serverGraph);
+        } else {
+            log_ok(SERVER, "Automaton is not reduced (%d states)", originalStates);
+        }
+    }
+#endif
+
+    /*
+     * In convert mode only write the binary automaton (see automaton_image.h).
+     */
+    if(graphImageOutputPath != NULL) {
+        if(!saveTransitionGraphImageFile(serverGraph, graphImageOutputPath)) {
+            fatal(SERVER, "Failed to write the binary automaton %s", graphImageOutputPath);
+        }
+        log_ok(SERVER, "Automaton converted into %s", graphImageOutputPath);
+        FREE(transitionGraphDesc);
+        if(serverGraph->image != NULL) {
+            unmapTransitionGraphImage(serverGraph);
+        } else {
+            freeTransitionGraph(serverGraph);
+        }
+        return 0;
+    }
+
+    /*
+     * In compile mode build the automaton into a shared object.
+     * If the build fails workers use the generic engine.
+     */
+    if(compileMode) {
+        snprintf(compiledAutomatonPath, sizeof(compiledAutomatonPath), "%s%lld.so", COMPILED_AUTOMATON_PATH_PREFIX, (long long) getpid());
+        compiledAvailable = compileTransitionGraph(serverGraph, compiledAutomatonPath);
+        if(compiledAvailable) {
+            log_ok(SERVER, "Automaton compiled into %s", compiledAutomatonPath);
+        } else {
+            log_warn(SERVER, "Failed to compile the automaton - use the generic engine.");
+        }
+    }
+
+#if USE_SHARED_GRAPH_IMAGE == 1
+    /*
+     * Share the parsed graph with the workers, so that they map it instead of receiving
+     * and parsing the description for each word.
+     */
+    snprintf(graphImageName, sizeof(graphImageName), "/FinAutomGraph%lld", (long long) getpid());
+    graphImageShared = shareTransitionGraphImage(serverGraph, graphImageName);
+    if(graphImageShared) {
+        log_ok(SERVER, "Graph image shared as %s", graphImageName);
+    } else {
+        log_warn(SERVER, "Failed to share the graph image - send the description to the workers.");
+    }
+#endif
+
+    LazyDFA serverDFA = NULL;
+#if USE_LAZY_DFA_ACCEPT == 1
+    /*
+     * The lazy DFA cache is kept for the whole server lifetime, so that it gets warm
+     * over the words of all the testers (building it for a single word never pays off).
+     */
+    const AcceptEngine serverEngine = (engineName != NULL) ? acceptEngineFromName(engineName) : ACCEPT_ENGINE_AUTO;
+    if(serverEngine == ACCEPT_ENGINE_AUTO || serverEngine == ACCEPT_ENGINE_LAZY) {
+        serverDFA = newLazyDFA(serverGraph, LAZY_DFA_MEMORY_LIMIT);
+    }
+#endif
+
+    // The description is needed only for the workers receiving the graph by the pipe
+    if(!graphImageShared && transitionGraphDesc == NULL) {
+        transitionGraphDesc = saveTransitionGraphDesc(serverGraph);
+    }
 
     // Queue to receive commands from testers
     MsgQueue reportQueue = msgQueueOpen("/FinAutomReportQueue", LINE_BUF_SIZE, MSG_QUEUE_SIZE);
@@ -138,6 +363,9 @@ int main(int argc, char *argv[]) {
     // Helper uffers to store other values
     long long buffer_pid;
     int buffer_result;
+    double buffer_node_cost;
+    double buffer_spawn_cost;
+    double buffer_thread_cost;
     int loc_id;
     
     log_ok(SERVER, "Server is up.");
@@ -162,7 +390,6 @@ int main(int argc, char *argv[]) {
     
     // Server event loop
     while(1) {
-        ++cycle_num;
         
         /*
          * Read all available (if any) incoming register events and start sessions for all the testers.
@@ -184,6 +411,10 @@ int main(int argc, char *argv[]) {
                     ts_new_val.pid = tester_pid;
                     ts_new_val.rcd_count = 0;
                     ts_new_val.acc_count = 0;
+                    ts_new_val.lastWord[0] = '\0';
+                    ts_new_val.lastWordValid = 0;
+                    ts_new_val.snapshot = NULL;
+                    ts_new_val.snapshotExhausted = 0;
                     ts_new_val.testerInputQueue = msgQueueOpen(buffer2, LINE_BUF_SIZE, MSG_QUEUE_SIZE);
                         
                     strcpy((char*) &(ts_new_val.queueName), buffer);
@@ -228,10 +459,22 @@ int main(int argc, char *argv[]) {
         char* run_term_msg = msgQueueRead(runOutputQueue);
         
         if(run_term_msg != NULL) {
-            if(sscanf(run_term_msg, "run-terminate: %lld %d", &buffer_pid, &buffer_result)) {
+            const int run_term_fields = sscanf(run_term_msg, "run-terminate: %lld %d %lf %lf %lf", &buffer_pid, &buffer_result, &buffer_node_cost, &buffer_spawn_cost, &buffer_thread_cost);
+            if(run_term_fields >= 2) {
                 --activeTasksCount;
                 log(SERVER, "Run terminated: %lld for result: %d", buffer_pid, buffer_result);
                 
+                /*
+                 * The worker has measured the costs, so move the learned values towards them
+                 * (exponential moving average, so single noisy measurement does not dominate).
+                 */
+                if(run_term_fields == 5 && buffer_node_cost > 0 && buffer_spawn_cost > 0 && buffer_thread_cost > 0) {
+                    learnedNodeCost += (buffer_node_cost - learnedNodeCost) / 4;
+                    learnedSpawnCost += (buffer_spawn_cost - learnedSpawnCost) / 4;
+                    learnedThreadCost += (buffer_thread_cost - learnedThreadCost) / 4;
+                    log(SERVER, "Learned costs: node %.1fns, fork %.1fns, thread %.1fns", learnedNodeCost, learnedSpawnCost, learnedThreadCost);
+                }
+                
                 /*
                  * The number of active worker sessions has decremented.
                  * So check out if the throttled mode can be disabled?
@@ -262,7 +505,9 @@ int main(int argc, char *argv[]) {
                      */
                     log_err(SERVER, "Missing run slot info for pid=%d", pid);
                 } else {
-                    msgPipeClose(&(rs->graphDataPipe));
+                    if(rs->hasGraphPipe) {
+                        msgPipeClose(&(rs->graphDataPipe));
+                    }
                 
                     /*
                      * This code will try to find matching tester session that is the source
@@ -411,6 +656,10 @@ int main(int argc, char *argv[]) {
                         ts_new_val.pid = tester_pid;
                         ts_new_val.rcd_count = 0;
                         ts_new_val.acc_count = 0;
+                        ts_new_val.lastWord[0] = '\0';
+                        ts_new_val.lastWordValid = 0;
+                        ts_new_val.snapshot = NULL;
+                        ts_new_val.snapshotExhausted = 0;
                         ts_new_val.testerInputQueue = msgQueueOpen(buffer2, LINE_BUF_SIZE, MSG_QUEUE_SIZE);
                         
                         strcpy((char*) &(ts_new_val.queueName), buffer);
@@ -423,77 +672,161 @@ int main(int argc, char *argv[]) {
                     // Update request statistics
                     ++(ts->rcd_count);
                     
+                    int answered = 0;
+#if USE_SESSION_SNAPSHOTS == 1
                     /*
-                     * Create new worker session
+                     * If the word extends the previous word of the tester then
+                     * answer it from the session snapshot (only the appended letters are evaluated).
                      */
-                    RunSlot rs;
-                    rs.loc_id = loc_id;
-                    rs.testerSourcePid = (pid_t) buffer_pid;
-                    rs.graphDataPipeID = msgPipeCreate(FILE_BUF_SIZE);
-                    rs.graphDataPipe = msgPipeOpen(rs.graphDataPipeID);
-                    
-                    char graphDataPipeIDStr[1000];
-                    msgPipeIDToStr(rs.graphDataPipeID, graphDataPipeIDStr);
-                    
-                    pid_t pid;
+                    if(testerSlotResume(ts, serverGraph, buffer, &buffer_result)) {
+                        answered = 1;
+                        log(SERVER, "Word {%s} answered from session snapshot", buffer);
+                    }
+#endif
                     
-                    /* 
-                     * Spawn the worker.
-                     * If the -v option is present then it's passed to the worker process.
+                    /*
+                     * Words with small run tree are cheaper to evaluate than to spawn the worker,
+                     * so evaluate them in the server (see estimateRunTree).
                      */
-                    char* vFlag = "-v";
-                    char* vFlagArg = NULL;
-                     
-                    if(verboseMode) {
-                        vFlagArg = vFlag;
-                    } else {
-                        vFlagArg = NULL;
+                    if(!answered && SERVER_INLINE_TREE_LIMIT > 0) {
+                        const double treeSize = estimateRunTree(serverGraph, buffer, strlen(buffer), SERVER_INLINE_TREE_LIMIT, NULL);
+                        if(treeSize <= SERVER_INLINE_TREE_LIMIT) {
+                            buffer_result = acceptSync(serverGraph, buffer);
+                            answered = 1;
+                            log(SERVER, "Word {%s} answered inline (run tree of %.0f nodes)", buffer, treeSize);
+                        } else {
+                            log(SERVER, "Word {%s} has run tree above %d nodes - spawn worker", buffer, SERVER_INLINE_TREE_LIMIT);
+                        }
                     }
                     
+#if USE_LAZY_DFA_ACCEPT == 1
                     /*
-                     * This loops do the spawning.
-                     * If exec fails then rety a few times...
+                     * Words for which the dispatcher picks the lazy DFA are answered by the server
+                     * with its long-lived cache (see selectAcceptEngine).
                      */
-                    int retry_count = 0;
-                    int worker_spawned = 1;
-                    
-                    log_info(SERVER, "Spawn worker...");
+                    if(!answered && serverDFA != NULL) {
+                        if(serverEngine == ACCEPT_ENGINE_LAZY || selectAcceptEngine(serverGraph, serverDFA, buffer, NULL) == ACCEPT_ENGINE_LAZY) {
+                            buffer_result = acceptLazyDFA(serverDFA, buffer);
+                            answered = 1;
+                            log(SERVER, "Word {%s} answered by the server lazy DFA (%d cached states)", buffer, serverDFA->count);
+                        }
+                    }
+#endif
                     
-                    while(!processExec(&pid, "./run", "run", graphDataPipeIDStr, buffer, vFlagArg, NULL)) {
-                        log_err(SERVER, "Worker process has failed, try to retry...");
-                        ++retry_count;
-                        if(retry_count >= SERVER_FORK_RETRY_COUNT) {
-                            worker_spawned = 0;
-                            break;
+                    if(answered) {
+                        ++snt_count;
+                        if(buffer_result == 1) {
+                            ++acc_count;
+                            ++(ts->acc_count);
                         }
-                        sleep(1);
+                        log_ok(SERVER, "Sent answer to the tester with pid=%d from the server (answer=%d, loc_id=%d)", ts->pid, buffer_result, loc_id);
+                        msgQueueWritef(ts->testerInputQueue, "%d answer: %d", loc_id, buffer_result);
                     }
                     
-                    if(worker_spawned) {
+                    if(!answered) {
+                        /*
+                         * Create new worker session
+                         */
+                        RunSlot rs;
+                        rs.loc_id = loc_id;
+                        rs.testerSourcePid = (pid_t) buffer_pid;
+                        rs.hasGraphPipe = !graphImageShared;
+                    
+                        // The workers map the shared graph image, the pipe is needed only without it
+                        char graphDataPipeIDStr[1000] = "-";
+                        if(rs.hasGraphPipe) {
+                            rs.graphDataPipeID = msgPipeCreate(FILE_BUF_SIZE);
+                            rs.graphDataPipe = msgPipeOpen(rs.graphDataPipeID);
+                            msgPipeIDToStr(rs.graphDataPipeID, graphDataPipeIDStr);
+                        }
+                    
+                        pid_t pid;
+                    
+                        /* 
+                         * Spawn the worker.
+                         * If the -v option is present then it's passed to the worker process.
+                         * If the automaton was compiled then its path is passed with -c option.
+                         * If the engine was forced then it's passed with -e option.
+                         * The learned costs are passed with -t option.
+                         * The name of the shared graph image is passed with -g option.
+                         */
+                        char* workerArgs[12] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
+                        int workerArgsCount = 0;
+                     
+                        if(verboseMode) {
+                            workerArgs[workerArgsCount++] = "-v";
+                        }
+                        if(compiledAvailable) {
+                            workerArgs[workerArgsCount++] = "-c";
+                            workerArgs[workerArgsCount++] = compiledAutomatonPath;
+                        }
+                        if(engineName != NULL) {
+                            workerArgs[workerArgsCount++] = "-e";
+                            workerArgs[workerArgsCount++] = (char*) engineName;
+                        }
+                        char nodeCostStr[64];
+                        char spawnCostStr[64];
+                        char threadCostStr[64];
+                        snprintf(nodeCostStr, sizeof(nodeCostStr), "%.1f", learnedNodeCost);
+                        snprintf(spawnCostStr, sizeof(spawnCostStr), "%.1f", learnedSpawnCost);
+                        snprintf(threadCostStr, sizeof(threadCostStr), "%.1f", learnedThreadCost);
+                        workerArgs[workerArgsCount++] = "-t";
+                        workerArgs[workerArgsCount++] = nodeCostStr;
+                        workerArgs[workerArgsCount++] = spawnCostStr;
+                        workerArgs[workerArgsCount++] = threadCostStr;
+                        if(graphImageShared) {
+                            workerArgs[workerArgsCount++] = "-g";
+                            workerArgs[workerArgsCount++] = graphImageName;
+                        }
+                    
+                        /*
+                         * This loops do the spawning.
+                         * If exec fails then rety a few times...
+                         */
+                        int retry_count = 0;
+                        int worker_spawned = 1;
+                    
+                        log_info(SERVER, "Spawn worker...");
+                    
+                        while(!processExec(&pid, "./run", "run", graphDataPipeIDStr, buffer, workerArgs[0], workerArgs[1], workerArgs[2], workerArgs[3], workerArgs[4], workerArgs[5], workerArgs[6], workerArgs[7], workerArgs[8], workerArgs[9], workerArgs[10], NULL)) {
+                            log_err(SERVER, "Worker process has failed, try to retry...");
+                            ++retry_count;
+                            if(retry_count >= SERVER_FORK_RETRY_COUNT) {
+                                worker_spawned = 0;
+                                break;
+                            }
+                            sleep(1);
+                        }
+                    
+                        if(worker_spawned) {
                         
-                        log_ok(SERVER, "Forked run %d for word {%s} (loc_id=%d)", pid, buffer, loc_id);
-                        rs.pid = pid;
+                            log_ok(SERVER, "Forked run %d for word {%s} (loc_id=%d)", pid, buffer, loc_id);
+                            rs.pid = pid;
                         
-                        // Save worker session
-                        HashMapSetV(&runSlots, pid_t, RunSlot, pid, rs);
+                            // Save worker session
+                            HashMapSetV(&runSlots, pid_t, RunSlot, pid, rs);
                         
-                        log_info(SERVER, "Push graph into pipe");
+                            log_info(SERVER, "Push graph into pipe");
                         
-                        // Send the graph to the worker
-                        msgPipeWrite(rs.graphDataPipe, transitionGraphDesc);
-                        ++activeTasksCount;
+                            // Send the graph to the worker (unless it maps the shared image)
+                            if(rs.hasGraphPipe) {
+                                msgPipeWrite(rs.graphDataPipe, transitionGraphDesc);
+                            }
+                            ++activeTasksCount;
 
-                    } else {
-                        /*
-                         * Log the event
-                         *
-                         * In this scenario the worker could not be spawned so we do not save the session info
-                         * and try to continue normal execution.
-                         *
-                         * (we ommit one word)
-                         */
-                         log_err(SERVER, "Failed to fork worker, but continue anyway.");
+                        } else {
+                            /*
+                             * Log the event
+                             *
+                             * In this scenario the worker could not be spawned so we do not save the session info
+                             * and try to continue normal execution.
+                             *
+                             * (we ommit one word)
+                             */
+                             log_err(SERVER, "Failed to fork worker, but continue anyway.");
                          
+                        }
+                    
                     }
                     
                 } else {
@@ -523,7 +856,9 @@ int main(int argc, char *argv[]) {
     // Close all pipes for sending data to workers
     LOOP_HASHMAP(&runSlots, i) {
         RunSlot* rs = (RunSlot*) HashMapGetValue(i);
-        msgPipeClose(&(rs->graphDataPipe));
+        if(rs->hasGraphPipe) {
+            msgPipeClose(&(rs->graphDataPipe));
+        }
     }
     
     /*
@@ -544,6 +879,9 @@ int main(int argc, char *argv[]) {
             printf("Acc: %d\n", ts->acc_count);
         }
         msgQueueClose(&(ts->testerInputQueue));
+        if(ts->snapshot != NULL) {
+            freeAcceptStream(ts->snapshot);
+        }
     }
     
     // Destroy all sessions
@@ -556,12 +894,32 @@ int main(int argc, char *argv[]) {
     msgQueueRemove(&registerQueue);
     
     FREE(transitionGraphDesc);
+    if(serverDFA != NULL) {
+        freeLazyDFA(serverDFA);
+    }
+    if(serverGraph->image != NULL) {
+        unmapTransitionGraphImage(serverGraph);
+    } else {
+        freeTransitionGraph(serverGraph);
+    }
+    
+    // The workers still running keep their mappings of the image
+    if(graphImageShared) {
+        removeTransitionGraphImage(graphImageName);
+        graphImageShared = 0;
+    }
     
     /*
      * We should now have all children terminated, but wait for them if there's any worker left.
      */
     log(SERVER, "Final check to determine if no subprocess is left...");
     processWaitForAll();
+    
+    // No worker loads the compiled automaton anymore
+    if(compiledAvailable) {
+        unlink(compiledAutomatonPath);
+        compiledAvailable = 0;
+    }
     log_ok(SERVER, "Exit.");
     
     // Return server exit code
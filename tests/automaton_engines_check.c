@@ -0,0 +1,244 @@
+/**
+ * Implementation of Automaton for studies on Warsaw Univeristy
+ *
+ * [Accept engines check]
+ *   Compares the verdicts of the accept engines with acceptSync on random automata:
+ *   acceptLockstep and acceptBatch (on the batch of all the checked words), acceptBitset,
+ *   acceptBitsetDynamic, the fixed-width engines supported by the processor (see transitionGraphVariants),
+ *   the lazy DFA with the cache small enough to be flushed, the graph opened from its image
+ *   and the minimized graph.
+ *   The automata have up to 256 states, so the sets of 1, 2 and 4 words are all checked,
+ *   and some letters of the alphabet have no transitions.
+ *
+ *   Exits with non-zero code on the first mismatch.
+ *
+ * @author Piotr Styczyński <piotrsty1@gmail.com>
+ * @copyright MIT
+ * @date 2018-01-21
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "automaton.h"
+#include "automaton_image.h"
+#include "syslog.h"
+
+#include "gcinit.h"
+
+/*
+ * Number of the random automata checked
+ */
+#define CHECK_AUTOMATA_COUNT 60
+
+/*
+ * Number of the random words checked per automaton
+ */
+#define CHECK_WORDS_COUNT    60
+
+/*
+ * Maximum length of the checked words
+ */
+#define CHECK_WORD_LENGTH    8
+
+/*
+ * Memory limit of the lazy DFA cache (it holds only a few DFA states, so it's flushed often)
+ */
+#define CHECK_LAZY_DFA_MEMORY 512
+
+/*
+ * Writes the description of random automaton to the buffer (see loadTransitionGraph for the format).
+ * Returns the size of the alphabet.
+ */
+static int generateAutomaton(char* desc, unsigned int seed) {
+    srand(seed);
+    const int Q = 1 + rand() % 256;
+    const int A = 1 + rand() % 4;
+    const int U = rand() % (Q + 1);
+    const int q0 = rand() % Q;
+    // The last letter of the alphabet has no transitions in some of the automata
+    const int letters = (A > 1 && rand() % 3 == 0) ? A - 1 : A;
+    
+    int accepting[256];
+    int F = 0;
+    for(int q=0;q<Q;++q) {
+        if(rand() % 2) {
+            accepting[F++] = q;
+        }
+    }
+    
+    int len = sprintf(desc, "0 %d %d %d %d\n%d\n", A, Q, U, F, q0);
+    for(int i=0;i<F;++i) {
+        len += sprintf(desc + len, i ? " %d" : "%d", accepting[i]);
+    }
+    len += sprintf(desc + len, "\n");
+    
+    for(int q=0;q<Q;++q) {
+        for(int a=0;a<letters;++a) {
+            if(rand() % 4 == 0) {
+                continue;
+            }
+            const int count = 1 + rand() % 3;
+            len += sprintf(desc + len, "%d %c", q, 'a' + a);
+            for(int i=0;i<count;++i) {
+                len += sprintf(desc + len, " %d", rand() % Q);
+            }
+            len += sprintf(desc + len, "\n");
+        }
+    }
+    
+    return A;
+}
+
+/*
+ * Loads the graph from the description.
+ */
+static TransitionGraph loadAutomaton(char* desc) {
+    TransitionGraph tg = newTransitionGraph();
+    char* descIter = desc;
+    loadTransitionGraph(&descIter, tg);
+    return tg;
+}
+
+/*
+ * Reports the mismatch of the engine with acceptSync.
+ * Returns 1.
+ */
+static int reportMismatch(const char* engine, unsigned int seed, const char* word, int verdict, int expected) {
+    fprintf(stderr, "Mismatch for automaton %u and word \"%s\": %s %d, sync %d\n", seed, word, engine, verdict, expected);
+    return 1;
+}
+
+int main(void) {
+    
+    GC_SETUP();
+    log_set(0);
+    
+    char* desc = MALLOCATE_ARRAY(char, 1 << 20);
+    char* words[CHECK_WORDS_COUNT];
+    char wordsData[CHECK_WORDS_COUNT][CHECK_WORD_LENGTH + 1];
+    int expected[CHECK_WORDS_COUNT];
+    int results[CHECK_WORDS_COUNT];
+    int variantCount = 0;
+    int flushCount = 0;
+    
+    for(unsigned int seed=1;seed<=CHECK_AUTOMATA_COUNT;++seed) {
+        const int A = generateAutomaton(desc, seed);
+        TransitionGraph tg = loadAutomaton(desc);
+        
+        for(int k=0;k<CHECK_WORDS_COUNT;++k) {
+            const int word_len = rand() % (CHECK_WORD_LENGTH + 1);
+            for(int i=0;i<word_len;++i) {
+                wordsData[k][i] = 'a' + rand() % A;
+            }
+            wordsData[k][word_len] = '\0';
+            words[k] = wordsData[k];
+            expected[k] = acceptSync(tg, words[k]);
+        }
+        
+        // Batch entry points
+        acceptLockstep(tg, words, CHECK_WORDS_COUNT, results);
+        for(int k=0;k<CHECK_WORDS_COUNT;++k) {
+            if(results[k] != expected[k]) {
+                return reportMismatch("lockstep", seed, words[k], results[k], expected[k]);
+            }
+        }
+        acceptBatch(tg, words, CHECK_WORDS_COUNT, results);
+        for(int k=0;k<CHECK_WORDS_COUNT;++k) {
+            if(results[k] != expected[k]) {
+                return reportMismatch("batch", seed, words[k], results[k], expected[k]);
+            }
+        }
+        
+        // Bitset engines (the selected one, the dynamic one and all the fixed-width ones for this width)
+        const int variants = sizeof(transitionGraphVariants) / sizeof(transitionGraphVariants[0]);
+        const int kernels = sizeof(stepKernels) / sizeof(stepKernels[0]);
+        for(int k=0;k<CHECK_WORDS_COUNT;++k) {
+            int verdict = acceptBitset(tg, words[k]);
+            if(verdict != expected[k]) {
+                return reportMismatch("bitset", seed, words[k], verdict, expected[k]);
+            }
+            verdict = acceptBitsetDynamic(tg, words[k]);
+            if(verdict != expected[k]) {
+                return reportMismatch("bitset (dynamic)", seed, words[k], verdict, expected[k]);
+            }
+            if(tg->stepTables == NULL || tg->stepStride != tg->setWords) {
+                continue;
+            }
+            for(int v=0;v<variants;++v) {
+                if(transitionGraphVariants[v].words != tg->setWords) {
+                    continue;
+                }
+                int supported = 0;
+                for(int i=0;i<kernels;++i) {
+                    supported |= (stepKernels[i].kernel == transitionGraphVariants[v].kernel && stepKernelSupported(&stepKernels[i]));
+                }
+                if(!supported) {
+                    continue;
+                }
+                verdict = transitionGraphVariants[v].bitsetAccept(tg, words[k]);
+                if(verdict != expected[k]) {
+                    return reportMismatch("bitset (fixed-width)", seed, words[k], verdict, expected[k]);
+                }
+                ++variantCount;
+            }
+        }
+        
+        // Lazy DFA with the cache flushed while the words are evaluated
+        LazyDFA dfa = newLazyDFA(tg, CHECK_LAZY_DFA_MEMORY);
+        for(int k=0;k<CHECK_WORDS_COUNT;++k) {
+            const int verdict = acceptLazyDFA(dfa, words[k]);
+            if(verdict != expected[k]) {
+                return reportMismatch("lazy", seed, words[k], verdict, expected[k]);
+            }
+        }
+        flushCount += dfa->flushCount;
+        freeLazyDFA(dfa);
+        
+        // Graph opened from its image
+        size_t imageSize = 0;
+        char* image = saveTransitionGraphImage(tg, &imageSize);
+        TransitionGraph imageGraph = openTransitionGraphImage(image, imageSize);
+        if(imageGraph == NULL) {
+            fprintf(stderr, "The image of automaton %u was not opened\n", seed);
+            return 1;
+        }
+        for(int k=0;k<CHECK_WORDS_COUNT;++k) {
+            int verdict = acceptSync(imageGraph, words[k]);
+            if(verdict != expected[k]) {
+                return reportMismatch("image sync", seed, words[k], verdict, expected[k]);
+            }
+            verdict = acceptBitset(imageGraph, words[k]);
+            if(verdict != expected[k]) {
+                return reportMismatch("image bitset", seed, words[k], verdict, expected[k]);
+            }
+        }
+        freeTransitionGraph(imageGraph);
+        FREE(image);
+        
+        // Minimized graph
+        TransitionGraph minimized = loadAutomaton(desc);
+        minimizeTransitionGraph(minimized);
+        for(int k=0;k<CHECK_WORDS_COUNT;++k) {
+            const int verdict = acceptSync(minimized, words[k]);
+            if(verdict != expected[k]) {
+                return reportMismatch("minimized sync", seed, words[k], verdict, expected[k]);
+            }
+        }
+        freeTransitionGraph(minimized);
+        
+        freeTransitionGraph(tg);
+    }
+    FREE(desc);
+    
+    if(variantCount == 0) {
+        fprintf(stderr, "No fixed-width engine was checked\n");
+        return 1;
+    }
+    if(flushCount == 0) {
+        fprintf(stderr, "The lazy DFA cache was never flushed\n");
+        return 1;
+    }
+    printf("OK (%d fixed-width engine runs, %d lazy DFA flushes)\n", variantCount, flushCount);
+    return 0;
+}
@@ -0,0 +1,186 @@
+/**
+ * Implementation of Automaton for studies on Warsaw Univeristy
+ *
+ * [Streaming accept check]
+ *   Compares the verdicts of the streaming accept (see automaton_stream.h) with acceptSync
+ *   on random automata. The automata have existential states with many successors, so the
+ *   stream formula exceeds the initial capacity of the clause buffers (16 clauses) and they are grown
+ *   while the clauses are expanded.
+ *   Then checks that a word buffered past ACCEPT_STREAM_PENDING_LIMIT exhausts the stream.
+ *
+ *   Exits with non-zero code on the first mismatch.
+ *
+ * @author Piotr Styczyński <piotrsty1@gmail.com>
+ * @copyright MIT
+ * @date 2018-01-21
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "automaton.h"
+#include "automaton_stream.h"
+#include "syslog.h"
+
+#include "gcinit.h"
+
+/*
+ * Number of the random automata checked
+ */
+#define CHECK_AUTOMATA_COUNT 300
+
+/*
+ * Number of the random words checked per automaton
+ */
+#define CHECK_WORDS_COUNT    30
+
+/*
+ * Maximum length of the checked words
+ */
+#define CHECK_WORD_LENGTH    6
+
+/*
+ * Writes the description of random automaton to the buffer (see loadTransitionGraph for the format).
+ * Returns the size of the alphabet.
+ */
+static int generateAutomaton(char* desc, unsigned int seed) {
+    srand(seed);
+    const int Q = 4 + rand() % 37;
+    const int A = 1 + rand() % 3;
+    const int U = rand() % (Q + 1);
+    const int q0 = (U < Q && rand() % 2) ? U + rand() % (Q - U) : rand() % Q;
+    
+    int accepting[64];
+    int F = 0;
+    for(int q=0;q<Q;++q) {
+        if(rand() % 2) {
+            accepting[F++] = q;
+        }
+    }
+    
+    int len = sprintf(desc, "0 %d %d %d %d\n%d\n", A, Q, U, F, q0);
+    for(int i=0;i<F;++i) {
+        len += sprintf(desc + len, i ? " %d" : "%d", accepting[i]);
+    }
+    len += sprintf(desc + len, "\n");
+    
+    for(int q=0;q<Q;++q) {
+        for(int a=0;a<A;++a) {
+            if(rand() % 4 == 0) {
+                continue;
+            }
+            // Existential states get many successors, so the formula has many clauses
+            const int count = (q >= U) ? 1 + rand() % 20 : 1 + rand() % 3;
+            len += sprintf(desc + len, "%d %c", q, 'a' + a);
+            for(int i=0;i<count;++i) {
+                len += sprintf(desc + len, " %d", rand() % Q);
+            }
+            len += sprintf(desc + len, "\n");
+        }
+    }
+    return A;
+}
+
+/*
+ * Checks the pending limit on the automaton with the formula of 2^13 clauses after the first letter:
+ * universal q0 requires the existential states 1..13, each of them chooses one of its two own successors.
+ * Returns 0 on success.
+ */
+static int checkPendingLimit(void) {
+    char desc[1024];
+    int len = sprintf(desc, "0 1 40 1 1\n0\n14\n0 a");
+    for(int q=1;q<=13;++q) {
+        len += sprintf(desc + len, " %d", q);
+    }
+    len += sprintf(desc + len, "\n");
+    for(int q=1;q<=13;++q) {
+        len += sprintf(desc + len, "%d a %d %d\n", q, 12 + 2 * q, 13 + 2 * q);
+    }
+    
+    TransitionGraph tg = newTransitionGraph();
+    char* descIter = desc;
+    loadTransitionGraph(&descIter, tg);
+    
+    // The first letter is expanded, the rest (starting with the one freezing the formula) is buffered
+    const int word_len = ACCEPT_STREAM_PENDING_LIMIT + 1;
+    char* word = MALLOCATE_ARRAY(char, word_len + 2);
+    memset(word, 'a', word_len + 1);
+    word[word_len + 1] = '\0';
+    
+    int status = 0;
+    AcceptStream st = newAcceptStream(tg);
+    if(!acceptStreamFeed(st, word, word_len) || st->pending == NULL) {
+        fprintf(stderr, "The stream formula was not frozen\n");
+        status = 1;
+    } else if(acceptStreamVerdict(st) != 0) {
+        fprintf(stderr, "Wrong verdict for the buffered word\n");
+        status = 1;
+    } else if(acceptStreamFeed(st, word, 1) || acceptStreamVerdict(st) != -1) {
+        fprintf(stderr, "The stream buffers more than %d letters\n", ACCEPT_STREAM_PENDING_LIMIT);
+        status = 1;
+    }
+    freeAcceptStream(st);
+    FREE(word);
+    freeTransitionGraph(tg);
+    return status;
+}
+
+int main(void) {
+    
+    GC_SETUP();
+    log_set(0);
+    
+    char* desc = MALLOCATE_ARRAY(char, 1 << 20);
+    int grownCount = 0;
+    
+    for(unsigned int seed=1;seed<=CHECK_AUTOMATA_COUNT;++seed) {
+        const int A = generateAutomaton(desc, seed);
+        TransitionGraph tg = newTransitionGraph();
+        char* descIter = desc;
+        loadTransitionGraph(&descIter, tg);
+        
+        AcceptStream st = newAcceptStream(tg);
+        for(int k=0;k<CHECK_WORDS_COUNT;++k) {
+            char word[CHECK_WORD_LENGTH + 1];
+            const int word_len = rand() % (CHECK_WORD_LENGTH + 1);
+            for(int i=0;i<word_len;++i) {
+                word[i] = 'a' + rand() % A;
+            }
+            word[word_len] = '\0';
+            
+            // Feed the word in random chunks
+            acceptStreamReset(st);
+            int fed = 0;
+            int maxClauses = st->clauseCount;
+            while(fed < word_len) {
+                const int chunk_len = 1 + rand() % (word_len - fed);
+                acceptStreamFeed(st, word + fed, chunk_len);
+                fed += chunk_len;
+                if(st->clauseCount > maxClauses) {
+                    maxClauses = st->clauseCount;
+                }
+            }
+            grownCount += (maxClauses > 16);
+            
+            const int expected = acceptSync(tg, word);
+            const int verdict = acceptStreamVerdict(st);
+            if(verdict != expected) {
+                fprintf(stderr, "Mismatch for automaton %u and word \"%s\": stream %d, sync %d\n", seed, word, verdict, expected);
+                return 1;
+            }
+        }
+        freeAcceptStream(st);
+        freeTransitionGraph(tg);
+    }
+    FREE(desc);
+    
+    if(checkPendingLimit() != 0) {
+        return 1;
+    }
+    if(grownCount == 0) {
+        fprintf(stderr, "No stream formula exceeded 16 clauses\n");
+        return 1;
+    }
+    printf("OK (%d words with more than 16 clauses)\n", grownCount);
+    return 0;
+}